@@ -14,13 +14,45 @@
 #include <time.h>
 #include <math.h>
 #include <signal.h>
+#include <stdint.h>
 
 #define MAX_DRONES 50
 #define MAX_TIMESTEPS 100
 #define MAX_COLLISIONS 100
+#define MAX_EPISODES 1000
+#define MAX_SUBSTEP_COLLISIONS 200
+#define DEFAULT_SUBSTEPS 8
+#define MAX_SUBSTEPS 64
+#define MAX_ENV_BOXES 64
+#define MAX_ENV_HITS 200
+#define ENV_GRID_CELLS 16
+#define CULL_LEVELS 3
+#define MAX_SLABS 16
+#define MAX_PARALLEL_THREADS 8 /* threads of one in-process parallel pass */
+#define PIPELINE_LAG 1 /* steps detection may trail the drones with -p */
+#define PIPELINE_SLOTS (PIPELINE_LAG + 1)
+
+/* paced mode lateness histogram: bucket 0 counts steps under 1 us late,
+   bucket k >= 1 counts [2^(k-1), 2^k) us and the last one everything above */
+#define JITTER_BUCKETS 16
+#define COLLISION_RATE_WINDOW 8
 #define DEFAULT_DRONE_SIZE 5
-#define CONFIG_PATH "data/info.csv"
-#define TRAJECTORY_PATH_FORMAT "data/drone%d_movement.csv"
+#define DEFAULT_DATA_DIR "data"
+#define CONFIG_PATH_FORMAT "%s/info.csv"
+#define TRAJECTORY_PATH_FORMAT "%s/drone%d_movement.csv"
+#define ENVIRONMENT_PATH_FORMAT "%s/environment.csv"
+#define CACHE_PATH_FORMAT "%s/collision_cache.bin"
+
+#define FIGURE_LINEAR 0
+#define FIGURE_CIRCULAR 1
+#define FIGURE_SPIRAL 2
+#define FIGURE_OSCILLATING 3
+#define FIGURE_PATTERNS 4
+#define SHM_NAME "/drone_sim"
+#define POOL_SOCKET_PATH "/tmp/drone_pool.sock"
+#define CREATE_LOCK_PATH "/tmp/drone_sim"
+#define DEFAULT_EVENT_LOG "simulation_events.bin"
+#define DEFAULT_REPORT_PATH "simulation_report.txt"
 
 typedef struct
 {
@@ -45,9 +77,19 @@ typedef struct
     int drone_id;
 } Drone;
 
+/* -k: a trajectory sample kept because the motion changes there; positions
+   between two keyframes are linearly interpolated, an invalid keyframe starts
+   a run of invalid samples */
+typedef struct
+{
+    int timestep;
+    Position pos;
+} Keyframe;
+
 typedef struct
 {
     int timestep;
+    float time; /* fractional for collisions found by sub-stepping */
     int drone1_id;
     int drone2_id;
     Position pos1;
@@ -63,19 +105,262 @@ typedef struct
     int is_valid;
 } TimeIndexedDroneState;
 
+/* binary event log: a sequence of EventRecordHeader + payload, every run
+   starts with an EVENT_RUN record */
+#define EVENT_LOG_MAGIC 0x4e4f5244
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_BUFFER_SIZE (1 << 20)
+#define EVENT_RUN 1
+#define EVENT_STEP 2
+#define EVENT_COLLISION 3
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+} EventRecordHeader;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t num_drones;
+    int32_t drone_size;
+    int32_t max_collisions;
+    int32_t time_steps;
+    int64_t start_time;
+} RunRecord;
+
+typedef struct
+{
+    int32_t timestep;
+    int32_t active_drones;
+    int32_t collision_count;
+    double latency;
+} StepSummaryRecord;
+
+/* per-timestep outcome of a drone pair as kept by the collision cache: the low
+   bits hold the colliding sub-step (PAIR_REFINED when the interval was refined
+   without a hit), PAIR_SAMPLED marks an overlap at the timestep itself */
+#define COLLISION_CACHE_MAGIC 0x45484341
+#define COLLISION_CACHE_VERSION 2
+#define PAIR_SUBSTEP_MASK 0x7f
+#define PAIR_REFINED 0x7f
+#define PAIR_SAMPLED 0x80
+
+/* compact state: int16 grid coordinates scaled by SharedMemory.quantisation_scale,
+   the bounding box is derived from the centre and quantised_drone_size (8 bytes
+   per drone per timestep instead of 40 for TimeIndexedDroneState) */
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t is_valid;
+} QuantisedState;
+
+#define AFFINITY_NONE 0
+#define AFFINITY_PINNED 1
+#define AFFINITY_TOPOLOGY 2
+
+#define PLACEMENT_COORDINATOR 0
+#define PLACEMENT_DETECTION 1
+#define PLACEMENT_REPORT 2
+#define PLACEMENT_DRONE 3
+
+typedef struct
+{
+    double min;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    int samples;
+} LatencySummary;
+
+typedef struct
+{
+    int quantised_states;
+    int affinity_policy;
+    int count_episodes;
+    float substep_margin;
+    int substeps;
+    int pool_size;
+    int use_cache;
+    int group_size;
+    int pipeline;
+    int huge_pages;
+    int prefault;
+    int slabs;
+    int keyframes;
+    float keyframe_tolerance;
+    float near_miss_factor; /* density map near-miss distance in drone sizes, 0 disables it */
+    int change_driven;
+    double step_period; /* seconds per timestep in paced mode, 0 runs unpaced */
+    char data_dir[256];
+    char event_log_path[256];
+    char report_path[256];
+    char figure_path[256];
+    char cache_path[300];
+    char solve_dir[256];
+    char trace_path[256];
+} SimulationOptions;
+
+#define ENV_OBSTACLE 0
+#define ENV_NOFLY 1
+#define ENV_GROUND 2
+
+typedef struct
+{
+    int type;
+    DroneAABB box;
+} EnvironmentBox;
+
+typedef struct
+{
+    int timestep;
+    int drone_id;
+    int env_id;
+    int type;
+    Position pos;
+} EnvironmentHit;
+
+/* consecutive timesteps in which the same pair overlaps */
+typedef struct
+{
+    int drone1_id;
+    int drone2_id;
+    int start_timestep;
+    int end_timestep;
+    float min_separation;
+    int samples;
+} CollisionEpisode;
+
 typedef struct
 {
     int detected;
     int timestep_first_detected;
+    int episode_id;
+    int generation; /* matrix_generation of the pre-calculation that wrote it */
     CollisionEvent event_data;
 } CollisionPairState;
 
+/* per-step summary shared by the coordinator (active drones, latency) and
+   the detection thread (collision count once the step is processed) */
+typedef struct
+{
+    int timestep;
+    int active_drones;
+    int collision_count;
+    double latency;
+} PipelineSlot;
+
+/* collisions of one processed step, published by the detection thread once
+   per step under SharedMemory.summary_sequence (a seqlock); totals and
+   per-drone hits are cumulative so a reader that skips a step loses nothing */
 typedef struct
 {
+    int timestep;
+    int new_collisions;
+    int total_collisions;
+    int threshold_margin;
+    int window_collisions; /* over the last window_steps steps */
+    int window_steps;
+    int drone_hits[MAX_DRONES];
+} StepCollisionSummary;
+
+/* live state for ./drone_monitor, written by the coordinator after every
+   step under SharedMemory.monitor_sequence (odd while writing) */
+typedef struct
+{
+    int timestep;
+    int time_steps;
+    int active_drones;
+    int collision_count;
+    int max_collisions;
+    int finished;
+    double latency;
+    double elapsed;
+} MonitorSnapshot;
+
+/* coordination tracer (-T): every thread or drone group appends to its own
+   buffer in shared memory, so recording takes no lock; the coordinator writes
+   the buffers out as a Chrome trace once the run is over */
+#define TRACE_CAPACITY 1024
+#define TRACE_COORDINATOR 0
+#define TRACE_DETECTION 1
+#define TRACE_REPORT 2
+#define TRACE_DRONES 3 /* buffer of drone group g is TRACE_DRONES + g */
+#define TRACE_BUFFERS (TRACE_DRONES + MAX_DRONES)
+
+#define TRACE_STEP_BEGIN 0   /* coordinator starts waiting for the barrier */
+#define TRACE_BARRIER_DONE 1 /* every expected group has arrived */
+#define TRACE_DETECT_WAIT 2  /* coordinator waits for the detection thread */
+#define TRACE_RELEASE 3      /* groups released to the next step */
+#define TRACE_WAKE 4         /* drone group woken */
+#define TRACE_ARRIVE 5       /* drone group posts its barrier arrival */
+#define TRACE_DETECT_START 6
+#define TRACE_DETECT_END 7
+#define TRACE_REPORT_WAKE 8
+
+/* step is the barrier round, detection of round s checks timestep s + 1 */
+typedef struct
+{
+    uint64_t ns;
+    int32_t step;
+    int32_t type;
+} TraceEvent;
+
+typedef struct
+{
+    char run_id[32];
+    char shm[64];
+    char sem_step_ready[64];
+    char sem_step_continue[64];
+    char sem_step_continue_odd[64];
+    char sem_pool_start[64];
+    char sem_pool_idle[64];
+    char pool_socket[108];
+    char create_lock[108]; /* held while the segment is created and its owner published */
+} IpcNames;
+
+typedef struct
+{
+    pid_t owner_pid; /* creator of the segment, used to recover stale runs */
     Drone drones[MAX_DRONES];
     CollisionEvent collisions[MAX_COLLISIONS];
-    TimeIndexedDroneState time_indexed_states[MAX_TIMESTEPS][MAX_DRONES];
+
+    /* per-step drone states in the one form the run uses, float states with
+       their boxes, int16 states with -q or keyframes with -k, which replace
+       both the states and the sampled trajectories; only that form is touched */
+    union
+    {
+        TimeIndexedDroneState time_indexed_states[MAX_TIMESTEPS][MAX_DRONES];
+        QuantisedState quantised_states[MAX_TIMESTEPS][MAX_DRONES];
+        Keyframe keyframes[MAX_DRONES][MAX_TIMESTEPS];
+    };
+    int keyframe_count[MAX_DRONES];
     CollisionPairState collision_matrix[MAX_TIMESTEPS][MAX_DRONES][MAX_DRONES];
+    CollisionEpisode episodes[MAX_EPISODES];
+    int episode_count;
+
+    CollisionEvent substep_collisions[MAX_SUBSTEP_COLLISIONS];
+    int substep_collision_count;
+    int substep_collisions_dropped; /* found after substep_collisions was full */
+    int substep_checks;
+
+    EnvironmentBox environment[MAX_ENV_BOXES];
+    int environment_count;
+    int has_ground_limit;
+    float ground_level;
+    EnvironmentHit env_hits[MAX_ENV_HITS];
+    int env_hit_count;
+    int env_hits_dropped;
+
+    SimulationOptions options;
+    float quantisation_scale;
+    int quantised_drone_size;
 
     int num_drones;
     int drone_size;
@@ -86,23 +371,73 @@ typedef struct
     int simulation_finished;
 
     int step_ready[MAX_DRONES];
+    sem_t group_wake[MAX_DRONES]; /* per-group release in change-driven stepping (-D) */
     int collision_detected;
     int report_ready;
-    int collision_detected_this_timestep[MAX_DRONES][MAX_DRONES];
+    int collision_detected_this_timestep[MAX_DRONES][MAX_DRONES]; /* pair_flag_generation stamps */
 
-    int timestep_ready_for_collision;
-    int collision_detection_complete;
+    /* generation stamps: a collision matrix entry or pair flag only counts when
+       it carries the current value, so neither is cleared between steps or runs */
+    int matrix_generation;
+    int pair_flag_generation;
+
+    /* slab decomposition (-x): pair outcomes written by the slab workers for
+       the pairs each owns, merged by the coordinator in serial order */
+    uint8_t slab_outcome[MAX_TIMESTEPS][MAX_DRONES][MAX_DRONES];
+    int slab_pairs[MAX_SLABS];
+    int slab_ghosts[MAX_SLABS];
+
+    /* detection hand-over: steps up to requested are released to the
+       detection thread, which processes them in order up to completed */
+    int detection_requested_step;
+    int detection_completed_step;
+    int threshold_timestep;
+    PipelineSlot pipeline[PIPELINE_SLOTS];
+
+    /* odd while the detection thread is writing step_summary */
+    volatile unsigned int summary_sequence;
+    StepCollisionSummary step_summary;
+
+    volatile unsigned int monitor_sequence;
+    MonitorSnapshot monitor;
 
     int active_drone_count;
     double simulation_start_time;
     double simulation_end_time;
+    double step_latency[MAX_TIMESTEPS];
+    int step_latency_count;
+    double startup_latency; /* process start to the release of the first step */
+    long startup_faults;
+
+    /* paced mode: lateness of each step release against its absolute deadline */
+    double step_lateness[MAX_TIMESTEPS];
+    int paced_steps;
+    int deadline_misses;
+    int jitter_histogram[JITTER_BUCKETS];
+
+    TraceEvent trace[TRACE_BUFFERS][TRACE_CAPACITY];
+    int trace_count[TRACE_BUFFERS];
+    int trace_dropped;
 
     int time_indexed_collision_detection_complete;
     int pre_calculation_complete;
+
+    /* persistent worker pool: next drone ID to hand out and shutdown request */
+    int pool_next_drone_id;
+    int pool_shutdown;
 } SharedMemory;
 
+extern IpcNames ipc_names;
 extern sem_t *sem_step_ready;
 extern sem_t *sem_step_continue;
+extern sem_t *sem_step_continue_odd;
+
+void set_ipc_namespace(const char *run_id);
+sem_t *step_continue_semaphore(int timestep);
+void advise_shared_memory(SharedMemory *shm);
+void prefault_hot_regions(SharedMemory *shm);
+int recover_stale_ipc(void);
+sem_t *create_semaphore(const char *name);
 
 void load_config(SharedMemory *shm);
 void load_drone_trajectory(int drone_id, SharedMemory *shm);
@@ -111,20 +446,101 @@ void initialise_simulation(SharedMemory *shm);
 DroneAABB drone_bounding(Position pos, int drone_size);
 int intersect(DroneAABB box1, DroneAABB box2);
 int is_valid_position(Position pos);
+int intersect_quantised(QuantisedState a, QuantisedState b, int size);
+Position dequantise_position(QuantisedState q, float scale);
+int is_state_valid(SharedMemory *shm, int timestep, int drone_id);
+int pair_detected(SharedMemory *shm, int timestep, int i, int j);
+Position state_position(SharedMemory *shm, int timestep, int drone_id);
+DroneAABB state_box(SharedMemory *shm, int timestep, int drone_id);
 
-void drone_process(int drone_id);
+void drone_process(int first_drone, int drone_count);
+void run_drone(int drone_id, SharedMemory *shm);
+void run_drone_group(int first_drone, int drone_count, SharedMemory *shm);
+int drone_group_count(SharedMemory *shm);
+int count_active_groups(SharedMemory *shm);
 void *collision_detection_thread(void *arg);
 void *report_generation_thread(void *arg);
 
 void update_drone_position(int drone_id, int timestep, SharedMemory *shm);
 void generate_final_report(SharedMemory *shm);
+int last_counted_step(SharedMemory *shm);
 void cleanup_resources(void);
 
+void create_shared_memory(void);
+void prepare_simulation(SharedMemory *shm);
+void create_synchronisation(void);
+void start_threads(void);
+void join_threads(void);
+void run_timesteps(SharedMemory *shm);
+void mark_startup(void);
+void stop_simulation(SharedMemory *shm);
+
+void pool_daemon(SimulationOptions *options);
+int pool_client(const char *command, SimulationOptions *options);
+
 void print_simulation_status(SharedMemory *shm);
 double get_current_time(void);
+LatencySummary summarise_step_latency(SharedMemory *shm);
+LatencySummary summarise_step_lateness(SharedMemory *shm);
+
+const char *affinity_policy_name(int policy);
+int parse_affinity_policy(const char *name);
+int plan_cpu_placement(int policy);
+void apply_placement(pthread_t thread, int role, int index);
+void release_placement(pthread_t thread);
+
+void open_event_log(SharedMemory *shm);
+void log_step_summary(PipelineSlot *slot);
+void log_collision_event(CollisionEvent *collision);
+void close_event_log(void);
+
+int load_figure(SharedMemory *shm);
+
+int parallel_thread_count(int units);
+void run_parallel_chunks(void *(*fn)(void *), void *chunks, int count, size_t size);
+
+void load_collision_cache(SharedMemory *shm);
+int cached_pair_outcome(int timestep, int i, int j);
+int current_pair_outcome(int timestep, int i, int j);
+void store_pair_outcome(int timestep, int i, int j, int outcome);
+void save_collision_cache(SharedMemory *shm);
+
+int solve_deconfliction(SharedMemory *shm);
+
+int cull_pairs(SharedMemory *shm);
+const uint16_t *candidate_pairs(int timestep, int *count);
+
+void store_keyframes(SharedMemory *shm, int drone_id, const Position *samples);
+void report_keyframes(SharedMemory *shm);
+Position trajectory_position(SharedMemory *shm, int drone_id, int timestep);
+int keyframe_window_box(SharedMemory *shm, int drone_id, int first, int last, DroneAABB *box);
+
+void build_density_map(SharedMemory *shm);
+
+void reset_trace(SharedMemory *shm);
+void trace_event(SharedMemory *shm, int buffer, int type, int step);
+void write_trace(SharedMemory *shm);
+
+int track_motion(SharedMemory *shm);
+int static_pair(SharedMemory *shm, int timestep, int i, int j);
+void build_changed_pairs(SharedMemory *shm);
+const uint16_t *detection_pairs(int timestep, int *count);
+void note_detection_hit(int timestep, uint16_t pair);
+int flying_drones(int timestep);
+int posting_groups(int timestep);
+void wake_groups(SharedMemory *shm, int timestep);
+
+void run_slab_workers(SharedMemory *shm);
+int slab_pair_outcome(SharedMemory *shm, int timestep, int i, int j);
+
+void load_environment(SharedMemory *shm);
+void check_environment(SharedMemory *shm, int timestep, int drone_id, Position pos, DroneAABB box);
+void report_environment_hits(SharedMemory *shm, FILE *report_file);
 
 void pre_calculate_positions(SharedMemory *shm);
+void quantise_positions(SharedMemory *shm);
 void collision_detection(SharedMemory *shm);
+int evaluate_pair(SharedMemory *shm, int timestep, int i, int j);
 void update_position(int drone_id, int timestep, SharedMemory *shm);
 int check_collision(int drone1_id, int drone2_id, int timestep, SharedMemory *shm);
 
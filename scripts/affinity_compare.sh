@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# runs the current scenario once per placement policy and prints the step latency lines
+for policy in none pinned topology; do
+    bash scripts/clean.sh
+    ./drone -a "$policy" > /dev/null
+    echo "== $policy"
+    grep -A3 "STEP LATENCY" simulation_report.txt
+done
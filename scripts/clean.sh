@@ -1,4 +1,5 @@
 #!/bin/bash
 
-rm -f simulation_report.txt
-rm -f /dev/shm/drone_sim /dev/shm/sem_step /dev/shm/sem_collision /dev/shm/sem.sem_step_ready /dev/shm/sem.sem_step_continue
\ No newline at end of file
+rm -f simulation_report.txt density_map.csv
+rm -f /dev/shm/drone_sim /dev/shm/drone_sim.* /dev/shm/sem_step /dev/shm/sem_collision /dev/shm/sem.sem_step_* /dev/shm/sem.sem_pool_*
+rm -f /tmp/drone_pool.sock /tmp/drone_pool.sock.*
\ No newline at end of file
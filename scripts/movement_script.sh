@@ -9,6 +9,10 @@ mkdir -p data
 > data/info.csv
 echo "$N_DRONES, $DRONE_SIZE, $COLLISIONS, $STEPS" >> data/info.csv
 
+# every pattern is also described in data/figure.txt for ./drone -f data/figure.txt,
+# FIGURE_ONLY=1 skips the per-timestep movement files
+> data/figure.txt
+
 generate_linear_movement() {
     drone_id=$1
     start_x=$2
@@ -17,7 +21,9 @@ generate_linear_movement() {
     x_inc=$5
     y_inc=$6
     z_inc=$7
-    
+
+    echo "$drone_id linear $start_x $start_y $start_z $x_inc $y_inc $z_inc" >> data/figure.txt
+    [ -n "$FIGURE_ONLY" ] && return
     > "data/drone${drone_id}_movement.csv"
     for ((t=0; t<$STEPS; t++)); do
         x=$((start_x + t*x_inc))
@@ -34,7 +40,9 @@ generate_circular_movement() {
     z=$4
     radius=$5
     direction=$6
-    
+
+    echo "$drone_id circular $center_x $center_y $z $radius $direction" >> data/figure.txt
+    [ -n "$FIGURE_ONLY" ] && return
     > "data/drone${drone_id}_movement.csv"
     for ((t=0; t<$STEPS; t++)); do
         angle=$(echo "scale=6; $direction * $t*2*3.14159/$STEPS" | bc -l)
@@ -53,7 +61,9 @@ generate_spiral_movement() {
     start_z=$4
     radius=$5
     z_inc=$6
-    
+
+    echo "$drone_id spiral $center_x $center_y $start_z $radius $z_inc" >> data/figure.txt
+    [ -n "$FIGURE_ONLY" ] && return
     > "data/drone${drone_id}_movement.csv"
     for ((t=0; t<$STEPS; t++)); do
         angle=$(echo "scale=6; $t*2*3.14159/$STEPS" | bc -l)
@@ -75,7 +85,9 @@ generate_oscillating_movement() {
     amplitude_x=$5
     amplitude_y=$6
     amplitude_z=$7
-    
+
+    echo "$drone_id oscillating $center_x $center_y $center_z $amplitude_x $amplitude_y $amplitude_z" >> data/figure.txt
+    [ -n "$FIGURE_ONLY" ] && return
     > "data/drone${drone_id}_movement.csv"
     for ((t=0; t<$STEPS; t++)); do
         angle=$(echo "scale=6; $t*2*3.14159/$STEPS" | bc -l)
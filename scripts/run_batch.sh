@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# runs several scenarios at once, each in its own IPC namespace
+# usage: scripts/run_batch.sh [-k concurrent] [-c cpu_list] scenario_dir...
+# every scenario_dir holds info.csv and the drone movement files, the report
+# and terminal output are written next to them
+
+CONCURRENT=$(nproc)
+CPUS=""
+
+while getopts "k:c:" opt; do
+    case $opt in
+        k) CONCURRENT=$OPTARG ;;
+        c) CPUS=$OPTARG ;;
+        *) echo "usage: $0 [-k concurrent] [-c cpu_list] scenario_dir..." >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+    echo "usage: $0 [-k concurrent] [-c cpu_list] scenario_dir..." >&2
+    exit 1
+fi
+
+# bounded core usage: every simulation (and its drones) stays on CPU_LIST
+RUNNER=""
+if [ -n "$CPUS" ]; then
+    RUNNER="taskset -c $CPUS"
+fi
+
+# run IDs are numbered, directories with the same basename get their own namespace
+run_scenario() {
+    dir=$1
+    run_id="batch$$_$2"
+    $RUNNER ./drone -r "$run_id" -d "$dir" -o "$dir/simulation_report.txt" > "$dir/simulation.log" 2>&1
+    # the ID is unique to this batch, so nobody else can be waiting on its create lock
+    rm -f "/tmp/drone_sim.$run_id.lock"
+    echo "$dir: $(grep -m1 '^Result:' "$dir/simulation.log" || echo 'no result (see simulation.log)')"
+}
+
+index=0
+for dir in "$@"; do
+    index=$((index + 1))
+    while [ "$(jobs -rp | wc -l)" -ge "$CONCURRENT" ]; do
+        wait -n
+    done
+    run_scenario "$dir" "$index" &
+done
+wait
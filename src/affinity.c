@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include "../includes/simulation.h"
+#include <sched.h>
+
+/* CPU plan computed once by the coordinator and inherited by every fork */
+static int placement_policy = AFFINITY_NONE;
+static int coordinator_cpu = -1;
+static int detection_cpu = -1;
+static int worker_cpus[CPU_SETSIZE];
+static int worker_cpu_count = 0;
+static cpu_set_t planned_cpus; /* every CPU the plan was made from */
+
+const char *affinity_policy_name(int policy)
+{
+    switch (policy)
+    {
+    case AFFINITY_PINNED:
+        return "pinned";
+    case AFFINITY_TOPOLOGY:
+        return "topology";
+    default:
+        return "none";
+    }
+}
+
+int parse_affinity_policy(const char *name)
+{
+    if (strcmp(name, "none") == 0)
+        return AFFINITY_NONE;
+    if (strcmp(name, "pinned") == 0)
+        return AFFINITY_PINNED;
+    if (strcmp(name, "topology") == 0)
+        return AFFINITY_TOPOLOGY;
+    return -1;
+}
+
+/* reads the first CPU of a /sys cpu list such as "2,6" or "0-3", -1 if unknown */
+static int read_first_cpu(int cpu, const char *file)
+{
+    char path[128];
+    int first = -1;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, file);
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    if (fscanf(fp, "%d", &first) != 1)
+        first = -1;
+    fclose(fp);
+    return first;
+}
+
+/* physical core of a CPU, identified by its first SMT sibling */
+static int core_of(int cpu)
+{
+    int core = read_first_cpu(cpu, "topology/thread_siblings_list");
+    return core < 0 ? cpu : core;
+}
+
+/* last level cache domain of a CPU, identified by its first sharer */
+static int llc_of(int cpu)
+{
+    int llc = read_first_cpu(cpu, "cache/index3/shared_cpu_list");
+    if (llc < 0)
+        llc = read_first_cpu(cpu, "cache/index2/shared_cpu_list");
+    return llc < 0 ? 0 : llc;
+}
+
+/* builds the CPU plan from the CPUs this process may run on:
+   pinned   - first two CPUs for coordinator and detection, drones on the rest
+   topology - coordinator and detection on two different physical cores of the
+              same last level cache, their SMT siblings stay idle and the drones
+              get one hardware thread per remaining core before any sibling,
+   returns the policy actually in effect */
+int plan_cpu_placement(int policy)
+{
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE], count = 0, i, j, pass;
+    int reserved_core[2] = {-1, -1};
+    char str[200];
+
+    placement_policy = policy;
+    worker_cpu_count = 0;
+    if (policy == AFFINITY_NONE)
+        return AFFINITY_NONE;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        perror("sched_getaffinity");
+        placement_policy = AFFINITY_NONE;
+        return AFFINITY_NONE;
+    }
+    planned_cpus = allowed;
+
+    for (i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &allowed))
+            cpus[count++] = i;
+    }
+
+    if (count < 3)
+    {
+        snprintf(str, sizeof(str), "Warning: only %d CPUs available, placement policy disabled\n", count);
+        write(STDOUT_FILENO, str, strlen(str));
+        placement_policy = AFFINITY_NONE;
+        return AFFINITY_NONE;
+    }
+
+    if (policy == AFFINITY_PINNED)
+    {
+        coordinator_cpu = cpus[0];
+        detection_cpu = cpus[1];
+        for (i = 2; i < count; i++)
+            worker_cpus[worker_cpu_count++] = cpus[i];
+    }
+    else
+    {
+        coordinator_cpu = cpus[0];
+        reserved_core[0] = core_of(coordinator_cpu);
+        detection_cpu = -1;
+        for (i = 1; i < count && detection_cpu < 0; i++)
+        {
+            if (core_of(cpus[i]) != reserved_core[0] && llc_of(cpus[i]) == llc_of(coordinator_cpu))
+                detection_cpu = cpus[i];
+        }
+        for (i = 1; i < count && detection_cpu < 0; i++)
+        {
+            if (core_of(cpus[i]) != reserved_core[0])
+                detection_cpu = cpus[i];
+        }
+        if (detection_cpu < 0)
+            detection_cpu = cpus[1];
+        reserved_core[1] = core_of(detection_cpu);
+
+        /* pass 0 takes the first hardware thread of every free core, pass 1 the siblings */
+        for (pass = 0; pass < 2; pass++)
+        {
+            for (i = 0; i < count; i++)
+            {
+                int core = core_of(cpus[i]);
+                if (core == reserved_core[0] || core == reserved_core[1])
+                    continue;
+                if ((pass == 0) != (core == cpus[i]))
+                    continue;
+                worker_cpus[worker_cpu_count++] = cpus[i];
+            }
+        }
+
+        /* a machine made only of the reserved cores still needs somewhere for drones */
+        if (worker_cpu_count == 0)
+        {
+            for (j = 0; j < count; j++)
+            {
+                if (cpus[j] != coordinator_cpu && cpus[j] != detection_cpu)
+                    worker_cpus[worker_cpu_count++] = cpus[j];
+            }
+        }
+    }
+
+    snprintf(str, sizeof(str), "CPU placement (%s): coordinator %d, detection %d, %d CPUs for drones\n",
+             affinity_policy_name(policy), coordinator_cpu, detection_cpu, worker_cpu_count);
+    write(STDOUT_FILENO, str, strlen(str));
+    return policy;
+}
+
+/* pins a thread of this process to the CPU the plan gives its role */
+void apply_placement(pthread_t thread, int role, int index)
+{
+    cpu_set_t set;
+    int cpu;
+
+    if (placement_policy == AFFINITY_NONE)
+        return;
+
+    switch (role)
+    {
+    case PLACEMENT_COORDINATOR:
+    case PLACEMENT_REPORT:
+        /* the report thread mostly runs while the coordinator is blocked */
+        cpu = coordinator_cpu;
+        break;
+    case PLACEMENT_DETECTION:
+        cpu = detection_cpu;
+        break;
+    default:
+        cpu = worker_cpus[index % worker_cpu_count];
+        break;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thread, sizeof(set), &set) != 0)
+    {
+        perror("pthread_setaffinity_np");
+    }
+}
+
+/* gives a pinned thread back every CPU the plan was made from, so the
+   parallel passes it starts (figure evaluation, density map) are not
+   confined to its own CPU */
+void release_placement(pthread_t thread)
+{
+    if (placement_policy == AFFINITY_NONE)
+        return;
+
+    if (pthread_setaffinity_np(thread, sizeof(planned_cpus), &planned_cpus) != 0)
+    {
+        perror("pthread_setaffinity_np");
+    }
+}
@@ -0,0 +1,464 @@
+#include "../includes/simulation.h"
+#include <errno.h>
+
+/* micro-benchmarks of the collision and I/O kernels over synthetic circular
+   flights at several N x T sizes; every kernel is sampled bench_samples times,
+   each sample repeating it until BENCH_MIN_SAMPLE seconds have passed, and the
+   median ns/op is compared against a baseline file so a slowdown beyond the
+   tolerance fails the run. Absolute timings only compare on one machine, so a
+   baseline records its host and is only used there */
+
+#define BENCH_SAMPLES 5
+#define BENCH_MIN_SAMPLE 0.05
+#define BENCH_BOXES 1024
+#define BENCH_BOX_OPS 4000000
+#define MAX_BENCH_RESULTS 32
+#define MAX_BENCH_SAMPLES 64
+#define DEFAULT_BENCH_BASELINE "bench_baseline.txt"
+#define DEFAULT_BENCH_TOLERANCE 30.0
+
+typedef struct
+{
+    char name[64];
+    double ns_per_op;
+    double rate;
+    const char *rate_unit;
+} BenchResult;
+
+/* a single call of every kernel takes well over 10 us at these sizes */
+static const int bench_sizes[][2] = {{25, 50}, {MAX_DRONES, MAX_TIMESTEPS}};
+
+static BenchResult results[MAX_BENCH_RESULTS];
+static int result_count;
+static int bench_samples = BENCH_SAMPLES;
+static int report_fd;
+static char bench_dir[64];
+static volatile double sink;
+static Position box_positions[BENCH_BOXES];
+static DroneAABB boxes[BENCH_BOXES];
+
+typedef void (*BenchKernel)(SharedMemory *shm);
+
+/* CPU time of the calling thread, so time the benchmark is preempted or the
+   host steals from it does not count as kernel time */
+static double kernel_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* median seconds per call of kernel over bench_samples samples, each sample
+   repeats the kernel until BENCH_MIN_SAMPLE seconds have passed */
+static double time_kernel(BenchKernel kernel, SharedMemory *shm)
+{
+    double samples[MAX_BENCH_SAMPLES], start, elapsed;
+    int k, calls;
+
+    for (k = 0; k < bench_samples; k++)
+    {
+        calls = 0;
+        start = kernel_clock();
+        do
+        {
+            kernel(shm);
+            calls++;
+        } while ((elapsed = kernel_clock() - start) < BENCH_MIN_SAMPLE);
+        samples[k] = elapsed / calls;
+    }
+    qsort(samples, bench_samples, sizeof(double), compare_doubles);
+    return bench_samples % 2 ? samples[bench_samples / 2]
+                             : (samples[bench_samples / 2 - 1] + samples[bench_samples / 2]) / 2.0;
+}
+
+static void add_result(const char *name, double seconds, double ops, double rate, const char *rate_unit)
+{
+    BenchResult *r = &results[result_count++];
+
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->ns_per_op = seconds * 1e9 / ops;
+    r->rate = rate;
+    r->rate_unit = rate_unit;
+}
+
+static off_t file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+/* deterministic scenario in bench_dir, returns the bytes of movement files */
+static double write_scenario(int drones, int time_steps)
+{
+    char path[128];
+    unsigned int seed = 12345;
+    double bytes = 0.0;
+    FILE *fp;
+    int d, t;
+
+    snprintf(path, sizeof(path), CONFIG_PATH_FORMAT, bench_dir);
+    if (!(fp = fopen(path, "w")))
+    {
+        perror("fopen bench info.csv");
+        exit(2);
+    }
+    fprintf(fp, "%d,10,%d,%d\n", drones, MAX_COLLISIONS, time_steps);
+    fclose(fp);
+
+    for (d = 0; d < drones; d++)
+    {
+        int cx, cy, r, z;
+
+        seed = seed * 1103515245u + 12345u;
+        cx = 10 + (seed >> 16) % 60;
+        seed = seed * 1103515245u + 12345u;
+        cy = 10 + (seed >> 16) % 60;
+        seed = seed * 1103515245u + 12345u;
+        r = 5 + (seed >> 16) % 15;
+        seed = seed * 1103515245u + 12345u;
+        z = 1 + (seed >> 16) % 15;
+
+        snprintf(path, sizeof(path), TRAJECTORY_PATH_FORMAT, bench_dir, d + 1);
+        if (!(fp = fopen(path, "w")))
+        {
+            perror("fopen bench trajectory");
+            exit(2);
+        }
+        for (t = 0; t < time_steps; t++)
+        {
+            double a = t * 2.0 * M_PI / time_steps;
+            fprintf(fp, "%d,%d,%d\n", (int)(cx + r * cos(a)), (int)(cy + r * sin(a)), z);
+        }
+        fclose(fp);
+        bytes += file_size(path);
+    }
+    return bytes;
+}
+
+static void remove_scenario(int drones)
+{
+    char path[128];
+    int d;
+
+    for (d = 0; d < drones; d++)
+    {
+        snprintf(path, sizeof(path), TRAJECTORY_PATH_FORMAT, bench_dir, d + 1);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), CONFIG_PATH_FORMAT, bench_dir);
+    unlink(path);
+}
+
+static void bounding_kernel(SharedMemory *shm)
+{
+    float total = 0.0f;
+    int i;
+
+    (void)shm;
+    for (i = 0; i < BENCH_BOX_OPS; i++)
+    {
+        total += drone_bounding(box_positions[i % BENCH_BOXES], 10).minX;
+    }
+    sink = total;
+}
+
+static void intersect_kernel(SharedMemory *shm)
+{
+    int i, hits = 0;
+
+    (void)shm;
+    for (i = 0; i < BENCH_BOX_OPS; i++)
+    {
+        hits += intersect(boxes[i % BENCH_BOXES], boxes[(i * 7 + 1) % BENCH_BOXES]);
+    }
+    sink = hits;
+}
+
+static void bench_box_kernels(void)
+{
+    double bounding, intersecting;
+    int i;
+
+    for (i = 0; i < BENCH_BOXES; i++)
+    {
+        box_positions[i].x = (i * 37) % 200;
+        box_positions[i].y = (i * 91) % 200;
+        box_positions[i].z = (i * 13) % 40;
+        boxes[i] = drone_bounding(box_positions[i], 10);
+    }
+
+    bounding = time_kernel(bounding_kernel, NULL);
+    intersecting = time_kernel(intersect_kernel, NULL);
+
+    add_result("drone_bounding", bounding, BENCH_BOX_OPS,
+               BENCH_BOX_OPS / bounding / 1e6, "Mops/s");
+    add_result("intersect", intersecting, BENCH_BOX_OPS,
+               BENCH_BOX_OPS / intersecting / 1e6, "Mpairs/s");
+}
+
+static void load_kernel(SharedMemory *shm)
+{
+    int i;
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        load_drone_trajectory(i, shm);
+    }
+}
+
+/* copies the sampled collisions into the event list so the report has the
+   detail section a real run produces */
+static void fill_collisions(SharedMemory *shm)
+{
+    int t, i, j;
+
+    shm->collision_count = 0;
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        for (i = 0; i < shm->num_drones - 1; i++)
+        {
+            for (j = i + 1; j < shm->num_drones && shm->collision_count < MAX_COLLISIONS; j++)
+            {
+                if (pair_detected(shm, t, i, j))
+                    shm->collisions[shm->collision_count++] = shm->collision_matrix[t][i][j].event_data;
+            }
+        }
+    }
+    shm->current_timestep = shm->time_steps;
+}
+
+static void bench_size(SharedMemory *shm, int drones, int time_steps)
+{
+    double csv_bytes, report_bytes, load, pre, detect, report;
+    double states = (double)drones * time_steps;
+    double pairs = (double)drones * (drones - 1) / 2 * time_steps;
+    char name[64];
+
+    csv_bytes = write_scenario(drones, time_steps);
+    load_config(shm);
+
+    /* every kernel is timed on the output of the one before it */
+    load = time_kernel(load_kernel, shm);
+    pre = time_kernel(pre_calculate_positions, shm);
+    detect = time_kernel(collision_detection, shm);
+    fill_collisions(shm);
+    report = time_kernel(generate_final_report, shm);
+    report_bytes = file_size(shm->options.report_path);
+
+    snprintf(name, sizeof(name), "load_drone_trajectory/%dx%d", drones, time_steps);
+    add_result(name, load, states, csv_bytes / load / 1e6, "MB/s");
+    snprintf(name, sizeof(name), "pre_calculate_positions/%dx%d", drones, time_steps);
+    add_result(name, pre, states, states * sizeof(TimeIndexedDroneState) / pre / 1e6, "MB/s");
+    snprintf(name, sizeof(name), "collision_detection/%dx%d", drones, time_steps);
+    add_result(name, detect, pairs, pairs / detect / 1e6, "Mpairs/s");
+    snprintf(name, sizeof(name), "generate_final_report/%dx%d", drones, time_steps);
+    add_result(name, report, 1, report_bytes / report / 1e6, "MB/s");
+
+    unlink(shm->options.report_path);
+    remove_scenario(drones);
+}
+
+static int baseline_value(const char *path, const char *name, double *value)
+{
+    char line[200], key[64];
+    double v;
+    FILE *fp = fopen(path, "r");
+    int found = 0;
+
+    if (!fp)
+        return 0;
+    while (!found && fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "%63s %lf", key, &v) == 2 && strcmp(key, name) == 0)
+        {
+            *value = v;
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+/* host line of the baseline, returns 0 when the file is missing or has none */
+static int baseline_host(const char *path, char *host, size_t size)
+{
+    char line[200], name[64];
+    FILE *fp = fopen(path, "r");
+    int found = 0;
+
+    if (!fp)
+        return 0;
+    while (!found && fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "host %63s", name) == 1)
+        {
+            snprintf(host, size, "%s", name);
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static void write_baseline(const char *path, const char *host)
+{
+    char str[200];
+    FILE *fp;
+    int i;
+
+    if (!(fp = fopen(path, "w")))
+    {
+        perror("fopen bench baseline");
+        exit(3);
+    }
+    fprintf(fp, "host %s\n", host);
+    for (i = 0; i < result_count; i++)
+    {
+        fprintf(fp, "%s %.3f\n", results[i].name, results[i].ns_per_op);
+    }
+    fclose(fp);
+    snprintf(str, sizeof(str), "Baseline of %d kernels written to %s\n", result_count, path);
+    write(report_fd, str, strlen(str));
+}
+
+/* prints every result against the baseline, returns the regressions */
+static int compare_baseline(const char *path, double tolerance)
+{
+    char str[300];
+    double base;
+    int i, regressions = 0;
+
+    snprintf(str, sizeof(str), "%-34s %12s %16s %12s %8s\n",
+             "kernel", "ns/op", "rate", "baseline", "change");
+    write(report_fd, str, strlen(str));
+
+    for (i = 0; i < result_count; i++)
+    {
+        BenchResult *r = &results[i];
+        const char *verdict = "";
+        char rate[32];
+
+        snprintf(rate, sizeof(rate), "%.2f %s", r->rate, r->rate_unit);
+        if (!baseline_value(path, r->name, &base) || base <= 0.0)
+        {
+            snprintf(str, sizeof(str), "%-34s %12.2f %16s %12s %8s\n", r->name, r->ns_per_op, rate, "-", "new");
+            write(report_fd, str, strlen(str));
+            continue;
+        }
+
+        if (r->ns_per_op > base * (1.0 + tolerance / 100.0))
+        {
+            verdict = "  REGRESSION";
+            regressions++;
+        }
+        snprintf(str, sizeof(str), "%-34s %12.2f %16s %12.2f %+7.1f%%%s\n", r->name, r->ns_per_op, rate,
+                 base, (r->ns_per_op / base - 1.0) * 100.0, verdict);
+        write(report_fd, str, strlen(str));
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    SharedMemory *bench_shm;
+    const char *baseline = DEFAULT_BENCH_BASELINE;
+    double tolerance = DEFAULT_BENCH_TOLERANCE;
+    int opt, update = 0, regressions, devnull;
+    unsigned int s;
+    char str[300], host[64], recorded[64];
+
+    while ((opt = getopt(argc, argv, "b:t:r:u")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            baseline = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        case 'r':
+            if ((bench_samples = atoi(optarg)) < 1)
+                bench_samples = 1;
+            if (bench_samples > MAX_BENCH_SAMPLES)
+                bench_samples = MAX_BENCH_SAMPLES;
+            break;
+        case 'u':
+            update = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-b baseline] [-t tolerance_percent] [-r samples] [-u]\n", argv[0]);
+            fprintf(stderr, "  -b  baseline file of kernel ns/op figures (default %s)\n", DEFAULT_BENCH_BASELINE);
+            fprintf(stderr, "  -t  slowdown that counts as a regression (default %.0f%%)\n", DEFAULT_BENCH_TOLERANCE);
+            fprintf(stderr, "  -r  samples of at least %.0f ms per kernel, the median counts (default %d)\n",
+                    BENCH_MIN_SAMPLE * 1e3, BENCH_SAMPLES);
+            fprintf(stderr, "  -u  write the results as the new baseline instead of comparing\n");
+            exit(1);
+        }
+    }
+
+    /* a baseline from another machine says nothing about this one */
+    if (gethostname(host, sizeof(host)) == -1)
+        snprintf(host, sizeof(host), "unknown");
+    host[sizeof(host) - 1] = '\0';
+    if (!update && (!baseline_host(baseline, recorded, sizeof(recorded)) || strcmp(recorded, host) != 0))
+    {
+        fprintf(stderr, "No baseline for host %s in %s, record one with make bench-baseline first\n",
+                host, baseline);
+        exit(2);
+    }
+
+    if ((bench_shm = mmap(NULL, sizeof(SharedMemory), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(4);
+    }
+    snprintf(bench_dir, sizeof(bench_dir), "/tmp/drone_bench.XXXXXX");
+    if (!mkdtemp(bench_dir))
+    {
+        perror("mkdtemp");
+        exit(5);
+    }
+    snprintf(bench_shm->options.data_dir, sizeof(bench_shm->options.data_dir), "%s", bench_dir);
+    snprintf(bench_shm->options.report_path, sizeof(bench_shm->options.report_path),
+             "%s/report.txt", bench_dir);
+
+    /* the kernels print progress on stdout, results go to the original one */
+    report_fd = dup(STDOUT_FILENO);
+    if ((devnull = open("/dev/null", O_WRONLY)) == -1 || dup2(devnull, STDOUT_FILENO) == -1)
+    {
+        perror("redirect stdout");
+        exit(6);
+    }
+    close(devnull);
+
+    bench_box_kernels();
+    for (s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++)
+    {
+        bench_size(bench_shm, bench_sizes[s][0], bench_sizes[s][1]);
+    }
+    rmdir(bench_dir);
+    munmap(bench_shm, sizeof(SharedMemory));
+
+    if (update)
+    {
+        write_baseline(baseline, host);
+        return 0;
+    }
+
+    regressions = compare_baseline(baseline, tolerance);
+    snprintf(str, sizeof(str), "%d of %d kernels slower than baseline by more than %.0f%%\n",
+             regressions, result_count, tolerance);
+    write(report_fd, str, strlen(str));
+    return regressions > 0;
+}
@@ -0,0 +1,216 @@
+#include "../includes/simulation.h"
+
+/* on-disk cache of the pairwise pre-calculation: every drone is keyed by a
+   hash of its trajectory, and a pair whose two drones are unchanged since the
+   last run reloads its per-timestep outcomes instead of recomputing them */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t num_drones;
+    int32_t time_steps;
+    int32_t drone_size;
+    int32_t quantised_states;
+    int32_t substeps;
+    float substep_margin;
+    float quantisation_scale;
+    float keyframe_tolerance; /* -1 with sampled trajectories */
+} CacheHeader;
+
+static uint64_t drone_hash[MAX_DRONES];
+static int drone_unchanged[MAX_DRONES];
+static uint8_t pair_outcome[MAX_DRONES][MAX_DRONES][MAX_TIMESTEPS];
+
+/* FNV-1a over the trajectory samples the simulation uses, the keyframes with -k */
+static uint64_t trajectory_hash(SharedMemory *shm, int drone_id)
+{
+    const unsigned char *p = (const unsigned char *)shm->drones[drone_id].trajectory;
+    size_t n = shm->time_steps * sizeof(Position);
+    uint64_t h = 1469598103934665603ULL;
+
+    if (shm->options.keyframes)
+    {
+        p = (const unsigned char *)shm->keyframes[drone_id];
+        n = shm->keyframe_count[drone_id] * sizeof(Keyframe);
+    }
+
+    while (n--)
+    {
+        h ^= *p++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void fill_cache_header(SharedMemory *shm, CacheHeader *header)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic = COLLISION_CACHE_MAGIC;
+    header->version = COLLISION_CACHE_VERSION;
+    header->num_drones = shm->num_drones;
+    header->time_steps = shm->time_steps;
+    header->drone_size = shm->drone_size;
+    header->quantised_states = shm->options.quantised_states;
+    header->substeps = shm->options.substeps;
+    header->substep_margin = shm->options.substep_margin;
+    header->quantisation_scale = shm->options.quantised_states ? shm->quantisation_scale : 0.0f;
+    header->keyframe_tolerance = shm->options.keyframes ? shm->options.keyframe_tolerance : -1.0f;
+}
+
+/* hashes the current trajectories and reloads the outcomes of every pair of
+   unchanged drones; a different drone size, timestep count or detection mode
+   invalidates the whole cache */
+void load_collision_cache(SharedMemory *shm)
+{
+    CacheHeader header, current;
+    uint64_t cached_hash[MAX_DRONES];
+    int i, j, cached_drones, unchanged = 0, reused_pairs = 0;
+    char str[400];
+    FILE *fp;
+
+    memset(drone_unchanged, 0, sizeof(drone_unchanged));
+    memset(pair_outcome, 0, sizeof(pair_outcome));
+    if (!shm->options.use_cache)
+        return;
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        drone_hash[i] = trajectory_hash(shm, i);
+    }
+
+    if (!(fp = fopen(shm->options.cache_path, "rb")))
+    {
+        snprintf(str, sizeof(str), "Collision cache: %s not found, computing all pairs\n",
+                 shm->options.cache_path);
+        write(STDOUT_FILENO, str, strlen(str));
+        return;
+    }
+
+    fill_cache_header(shm, &current);
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != current.magic || header.version != current.version ||
+        header.num_drones <= 0 || header.num_drones > MAX_DRONES ||
+        header.time_steps != current.time_steps || header.drone_size != current.drone_size ||
+        header.quantised_states != current.quantised_states ||
+        header.substeps != current.substeps || header.substep_margin != current.substep_margin ||
+        header.quantisation_scale != current.quantisation_scale ||
+        header.keyframe_tolerance != current.keyframe_tolerance)
+    {
+        fclose(fp);
+        snprintf(str, sizeof(str), "Collision cache: %s does not match this configuration, computing all pairs\n",
+                 shm->options.cache_path);
+        write(STDOUT_FILENO, str, strlen(str));
+        return;
+    }
+
+    cached_drones = header.num_drones;
+    if (fread(cached_hash, sizeof(uint64_t), cached_drones, fp) != (size_t)cached_drones)
+    {
+        cached_drones = 0;
+    }
+
+    /* pairs are stored i < j, row by row, time_steps outcomes each */
+    for (i = 0; i < cached_drones - 1; i++)
+    {
+        for (j = i + 1; j < cached_drones; j++)
+        {
+            if (fread(pair_outcome[i][j], 1, header.time_steps, fp) != (size_t)header.time_steps)
+            {
+                cached_drones = 0;
+            }
+        }
+    }
+    fclose(fp);
+
+    for (i = 0; i < cached_drones && i < shm->num_drones; i++)
+    {
+        drone_unchanged[i] = cached_hash[i] == drone_hash[i];
+        unchanged += drone_unchanged[i];
+    }
+    /* outcomes of pairs that will be recomputed are cleared, culled and
+       invalid timesteps are never stored */
+    for (i = 0; i < shm->num_drones - 1; i++)
+    {
+        for (j = i + 1; j < shm->num_drones; j++)
+        {
+            if (drone_unchanged[i] && drone_unchanged[j])
+                reused_pairs++;
+            else
+                memset(pair_outcome[i][j], 0, sizeof(pair_outcome[i][j]));
+        }
+    }
+
+    snprintf(str, sizeof(str), "Collision cache: %d of %d drones unchanged, reusing %d of %d pairs\n",
+             unchanged, shm->num_drones, reused_pairs,
+             shm->num_drones * (shm->num_drones - 1) / 2);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* outcome of pair i < j at timestep from the cache, -1 when it must be computed */
+int cached_pair_outcome(int timestep, int i, int j)
+{
+    if (!drone_unchanged[i] || !drone_unchanged[j])
+        return -1;
+    return pair_outcome[i][j][timestep];
+}
+
+/* outcome of pair i < j at timestep in the current pre-calculation, 0 for
+   culled pairs; a compact index in front of the shared collision matrix */
+int current_pair_outcome(int timestep, int i, int j)
+{
+    return pair_outcome[i][j][timestep];
+}
+
+void store_pair_outcome(int timestep, int i, int j, int outcome)
+{
+    pair_outcome[i][j][timestep] = (uint8_t)outcome;
+}
+
+/* the cache is written to a file of this process next to it and renamed over
+   it once complete, so a reader never sees a torn cache, whether the writer
+   crashed or another run sharing the data directory saved at the same time */
+void save_collision_cache(SharedMemory *shm)
+{
+    CacheHeader header;
+    char temp_path[sizeof(shm->options.cache_path) + 32];
+    int i, j, ok;
+    FILE *fp;
+
+    if (!shm->options.use_cache)
+        return;
+
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", shm->options.cache_path, (int)getpid());
+    if (!(fp = fopen(temp_path, "wb")))
+    {
+        perror("fopen collision cache");
+        return;
+    }
+
+    fill_cache_header(shm, &header);
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(drone_hash, sizeof(uint64_t), shm->num_drones, fp) == (size_t)shm->num_drones;
+    for (i = 0; ok && i < shm->num_drones - 1; i++)
+    {
+        for (j = i + 1; ok && j < shm->num_drones; j++)
+        {
+            ok = fwrite(pair_outcome[i][j], 1, shm->time_steps, fp) == (size_t)shm->time_steps;
+        }
+    }
+
+    if (!ok)
+    {
+        perror("fwrite collision cache");
+    }
+    if (fclose(fp) != 0)
+    {
+        perror("fclose collision cache");
+        ok = 0;
+    }
+
+    if (!ok || rename(temp_path, shm->options.cache_path) == -1)
+    {
+        if (ok)
+            perror("rename collision cache");
+        unlink(temp_path);
+    }
+}
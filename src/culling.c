@@ -0,0 +1,159 @@
+#include "../includes/simulation.h"
+
+/* temporal hierarchy of swept bounding boxes: every drone gets one box per
+   window of 8, 64 and 512 timesteps, and a pair only reaches the per-timestep
+   checks in the windows where all three levels of its boxes overlap */
+static const int window_size[CULL_LEVELS] = {8, 64, 512};
+#define KEYFRAME_BOX_SLACK 0.001f
+static DroneAABB window_box[CULL_LEVELS][MAX_DRONES][MAX_TIMESTEPS / 8 + 1];
+static uint16_t candidates[MAX_TIMESTEPS][MAX_DRONES * (MAX_DRONES - 1) / 2];
+static int candidate_count[MAX_TIMESTEPS];
+
+static void grow_box(DroneAABB *box, DroneAABB *other)
+{
+    box->minX = fminf(box->minX, other->minX);
+    box->maxX = fmaxf(box->maxX, other->maxX);
+    box->minY = fminf(box->minY, other->minY);
+    box->maxY = fmaxf(box->maxY, other->maxY);
+    box->minZ = fminf(box->minZ, other->minZ);
+    box->maxZ = fmaxf(box->maxZ, other->maxZ);
+}
+
+/* a window box covers the drone box at every valid timestep of the window and
+   at the first timestep after it, widened by half the sub-step margin so a
+   culled pair can neither overlap nor trigger refinement inside the window */
+static void build_window_boxes(SharedMemory *shm)
+{
+    DroneAABB empty = {INFINITY, -INFINITY, INFINITY, -INFINITY, INFINITY, -INFINITY};
+    float half_size = shm->drone_size / 2.0f + shm->options.substep_margin / 2.0f;
+    int level, drone_id, w, t;
+
+    for (drone_id = 0; drone_id < shm->num_drones; drone_id++)
+    {
+        for (level = 0; level < CULL_LEVELS; level++)
+        {
+            for (w = 0; w <= (shm->time_steps - 1) / window_size[level]; w++)
+            {
+                window_box[level][drone_id][w] = empty;
+            }
+        }
+
+        /* keyframes: a linear segment lies in the box of its end points, so
+           each window only needs its ends and the keyframes inside; the
+           margin covers interpolation rounding */
+        if (shm->options.keyframes)
+        {
+            float pad = half_size + KEYFRAME_BOX_SLACK;
+            DroneAABB box;
+
+            for (w = 0; w <= (shm->time_steps - 1) / window_size[0]; w++)
+            {
+                t = (w + 1) * window_size[0];
+                if (!keyframe_window_box(shm, drone_id, w * window_size[0],
+                                         t < shm->time_steps ? t : shm->time_steps - 1, &box))
+                    continue;
+                box.minX -= pad;
+                box.maxX += pad;
+                box.minY -= pad;
+                box.maxY += pad;
+                box.minZ -= pad;
+                box.maxZ += pad;
+                window_box[0][drone_id][w] = box;
+            }
+        }
+
+        for (t = 0; !shm->options.keyframes && t < shm->time_steps; t++)
+        {
+            Position pos;
+            DroneAABB box;
+
+            if (!is_state_valid(shm, t, drone_id))
+                continue;
+
+            pos = state_position(shm, t, drone_id);
+            box = drone_bounding(pos, shm->drone_size);
+            if (shm->options.substep_margin > 0.0f)
+            {
+                box.minX = pos.x - half_size;
+                box.maxX = pos.x + half_size;
+                box.minY = pos.y - half_size;
+                box.maxY = pos.y + half_size;
+                box.minZ = pos.z - half_size;
+                box.maxZ = pos.z + half_size;
+            }
+
+            grow_box(&window_box[0][drone_id][t / window_size[0]], &box);
+            if (t > 0 && t % window_size[0] == 0)
+                grow_box(&window_box[0][drone_id][t / window_size[0] - 1], &box);
+        }
+
+        /* each level is the union of the eight windows below it */
+        for (level = 1; level < CULL_LEVELS; level++)
+        {
+            for (w = 0; w <= (shm->time_steps - 1) / window_size[level - 1]; w++)
+            {
+                grow_box(&window_box[level][drone_id][w * window_size[level - 1] / window_size[level]],
+                         &window_box[level - 1][drone_id][w]);
+            }
+        }
+    }
+}
+
+/* descends the hierarchy for pair i < j below window w of level */
+static int collect_pair_windows(SharedMemory *shm, int level, int w, int i, int j)
+{
+    int first, last, t, kept = 0;
+
+    if (!intersect(window_box[level][i][w], window_box[level][j][w]))
+        return 0;
+
+    if (level == 0)
+    {
+        last = (w + 1) * window_size[0];
+        if (last > shm->time_steps)
+            last = shm->time_steps;
+        for (t = w * window_size[0]; t < last; t++)
+        {
+            candidates[t][candidate_count[t]++] = i * MAX_DRONES + j;
+        }
+        return last - w * window_size[0];
+    }
+
+    first = w * window_size[level] / window_size[level - 1];
+    last = (w + 1) * window_size[level] / window_size[level - 1];
+    for (; first < last && first * window_size[level - 1] < shm->time_steps; first++)
+    {
+        kept += collect_pair_windows(shm, level - 1, first, i, j);
+    }
+    return kept;
+}
+
+/* builds the per-timestep candidate pair lists, pairs stay in (i, j) order;
+   returns the number of pair-timesteps left for the exact checks */
+int cull_pairs(SharedMemory *shm)
+{
+    int i, j, w, kept = 0;
+    int top = CULL_LEVELS - 1;
+
+    build_window_boxes(shm);
+    memset(candidate_count, 0, sizeof(candidate_count));
+
+    for (i = 0; i < shm->num_drones - 1; i++)
+    {
+        for (j = i + 1; j < shm->num_drones; j++)
+        {
+            for (w = 0; w <= (shm->time_steps - 1) / window_size[top]; w++)
+            {
+                kept += collect_pair_windows(shm, top, w, i, j);
+            }
+        }
+    }
+    return kept;
+}
+
+/* candidate pairs of a timestep, encoded as i * MAX_DRONES + j */
+const uint16_t *candidate_pairs(int timestep, int *count)
+{
+    *count = candidate_count[timestep];
+    return candidates[timestep];
+}
@@ -0,0 +1,202 @@
+#include "../includes/simulation.h"
+
+/* occupancy and near-miss density map (-M factor): every valid drone sample
+   is binned into a voxel grid over the flight volume, and every pair closer
+   than factor * drone_size at the voxel of its midpoint. The timesteps are
+   split across threads, each filling its own histograms, which are summed
+   once all threads are done */
+
+#define DENSITY_GRID 32
+#define DENSITY_VOXELS (DENSITY_GRID * DENSITY_GRID * DENSITY_GRID)
+#define DENSITY_FILE "density_map.csv"
+
+typedef struct
+{
+    SharedMemory *shm;
+    int slot;
+    int first_step;
+    int last_step;
+    int near_misses;
+} DensityChunk;
+
+static uint32_t occupancy[MAX_PARALLEL_THREADS][DENSITY_VOXELS];
+static uint32_t near_miss[MAX_PARALLEL_THREADS][DENSITY_VOXELS];
+static Position origin;
+static float voxel_size;
+static int dims[3];
+
+static int axis_cell(float value, float low, int axis)
+{
+    int cell = (int)((value - low) / voxel_size);
+
+    if (cell < 0)
+        return 0;
+    return cell < dims[axis] ? cell : dims[axis] - 1;
+}
+
+static int voxel_of(Position p)
+{
+    return (axis_cell(p.z, origin.z, 2) * dims[1] + axis_cell(p.y, origin.y, 1)) * dims[0] +
+           axis_cell(p.x, origin.x, 0);
+}
+
+/* cubic voxels sized so the longest side of the sampled volume spans the
+   grid; returns 0 when no drone is ever valid */
+static int plan_grid(SharedMemory *shm)
+{
+    Position low = {INFINITY, INFINITY, INFINITY}, high = {-INFINITY, -INFINITY, -INFINITY}, p;
+    float extent;
+    int t, i, found = 0;
+
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        for (i = 0; i < shm->num_drones; i++)
+        {
+            if (!is_state_valid(shm, t, i))
+                continue;
+            p = state_position(shm, t, i);
+            low.x = fminf(low.x, p.x);
+            low.y = fminf(low.y, p.y);
+            low.z = fminf(low.z, p.z);
+            high.x = fmaxf(high.x, p.x);
+            high.y = fmaxf(high.y, p.y);
+            high.z = fmaxf(high.z, p.z);
+            found = 1;
+        }
+    }
+    if (!found)
+        return 0;
+
+    extent = fmaxf(high.x - low.x, fmaxf(high.y - low.y, high.z - low.z));
+    voxel_size = extent > 0.0f ? extent / DENSITY_GRID : 1.0f;
+    origin = low;
+    dims[0] = dims[1] = dims[2] = DENSITY_GRID;
+    dims[0] = axis_cell(high.x, low.x, 0) + 1;
+    dims[1] = axis_cell(high.y, low.y, 1) + 1;
+    dims[2] = axis_cell(high.z, low.z, 2) + 1;
+    return 1;
+}
+
+static void *bin_density_chunk(void *arg)
+{
+    DensityChunk *chunk = (DensityChunk *)arg;
+    SharedMemory *shm = chunk->shm;
+    uint32_t *occupied = occupancy[chunk->slot], *missed = near_miss[chunk->slot];
+    float limit = shm->options.near_miss_factor * shm->drone_size;
+    Position a, b, mid;
+    int t, i, j;
+
+    memset(occupied, 0, sizeof(occupancy[0]));
+    memset(missed, 0, sizeof(near_miss[0]));
+    chunk->near_misses = 0;
+    for (t = chunk->first_step; t < chunk->last_step; t++)
+    {
+        for (i = 0; i < shm->num_drones; i++)
+        {
+            if (!is_state_valid(shm, t, i))
+                continue;
+            a = state_position(shm, t, i);
+            occupied[voxel_of(a)]++;
+
+            for (j = i + 1; j < shm->num_drones; j++)
+            {
+                if (!is_state_valid(shm, t, j))
+                    continue;
+                b = state_position(shm, t, j);
+                if ((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) +
+                        (a.z - b.z) * (a.z - b.z) >= limit * limit)
+                    continue;
+                mid.x = (a.x + b.x) / 2.0f;
+                mid.y = (a.y + b.y) / 2.0f;
+                mid.z = (a.z + b.z) / 2.0f;
+                missed[voxel_of(mid)]++;
+                chunk->near_misses++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* density_map.csv in the directory of the report */
+static void density_path(SharedMemory *shm, char *path, size_t size)
+{
+    const char *report = shm->options.report_path;
+    const char *slash = strrchr(report, '/');
+
+    if (slash)
+        snprintf(path, size, "%.*s/%s", (int)(slash - report), report, DENSITY_FILE);
+    else
+        snprintf(path, size, "%s", DENSITY_FILE);
+}
+
+/* sparse CSV volume: one grid line, then the non-empty voxels */
+static int write_density_map(const char *path, int thread_count, int *voxels)
+{
+    FILE *fp;
+    uint32_t occupied, missed;
+    int v, k;
+
+    if (!(fp = fopen(path, "w")))
+    {
+        perror("fopen density map");
+        return 0;
+    }
+    fprintf(fp, "# grid,nx,ny,nz,origin_x,origin_y,origin_z,voxel_size\n");
+    fprintf(fp, "grid,%d,%d,%d,%g,%g,%g,%g\n", dims[0], dims[1], dims[2],
+            origin.x, origin.y, origin.z, voxel_size);
+    fprintf(fp, "ix,iy,iz,occupancy,near_misses\n");
+
+    *voxels = 0;
+    for (v = 0; v < dims[0] * dims[1] * dims[2]; v++)
+    {
+        occupied = missed = 0;
+        for (k = 0; k < thread_count; k++)
+        {
+            occupied += occupancy[k][v];
+            missed += near_miss[k][v];
+        }
+        if (!occupied && !missed)
+            continue;
+        fprintf(fp, "%d,%d,%d,%u,%u\n", v % dims[0], v / dims[0] % dims[1],
+                v / (dims[0] * dims[1]), occupied, missed);
+        (*voxels)++;
+    }
+    fclose(fp);
+    return 1;
+}
+
+void build_density_map(SharedMemory *shm)
+{
+    DensityChunk chunks[MAX_PARALLEL_THREADS];
+    char path[300], str[400];
+    double start = get_current_time();
+    int i, thread_count, near_misses = 0, voxels;
+
+    if (shm->options.near_miss_factor <= 0.0f || !plan_grid(shm))
+        return;
+
+    thread_count = parallel_thread_count(shm->time_steps);
+    for (i = 0; i < thread_count; i++)
+    {
+        chunks[i].shm = shm;
+        chunks[i].slot = i;
+        chunks[i].first_step = shm->time_steps * i / thread_count;
+        chunks[i].last_step = shm->time_steps * (i + 1) / thread_count;
+    }
+    run_parallel_chunks(bin_density_chunk, chunks, thread_count, sizeof(DensityChunk));
+
+    for (i = 0; i < thread_count; i++)
+    {
+        near_misses += chunks[i].near_misses;
+    }
+
+    density_path(shm, path, sizeof(path));
+    if (!write_density_map(path, thread_count, &voxels))
+        return;
+
+    snprintf(str, sizeof(str),
+             "Density map: %d near misses under %.1f, %d of %d voxels used (voxel %.2f), written to %s in %.2f ms\n",
+             near_misses, shm->options.near_miss_factor * shm->drone_size, voxels,
+             dims[0] * dims[1] * dims[2], voxel_size, path, (get_current_time() - start) * 1e3);
+    write(STDOUT_FILENO, str, strlen(str));
+}
@@ -3,26 +3,31 @@
 extern pthread_mutex_t collision_mutex;
 extern pthread_cond_t collision_cond;
 
-/* drone process function - modified to use time-indexed positions */
-void drone_process(int drone_id)
+/* drone process function - modified to use time-indexed positions; the
+   process flies drone_count drones starting at first_drone */
+void drone_process(int first_drone, int drone_count)
 {
     int fd;
     SharedMemory *shm;
     char str[200];
 
-    if (drone_id < 0 || drone_id >= MAX_DRONES)
+    if (first_drone < 0 || drone_count < 1 || first_drone + drone_count > MAX_DRONES)
     {
-        snprintf(str, sizeof(str), "Warning: Invalid drone ID %d\n", drone_id);
+        snprintf(str, sizeof(str), "Warning: Invalid drone ID %d\n", first_drone);
         write(STDOUT_FILENO, str, strlen(str));
         exit(1);
     }
 
-    snprintf(str, sizeof(str), "Drone %d process started (PID: %d)\n",
-             drone_id, getpid());
+    if (drone_count == 1)
+        snprintf(str, sizeof(str), "Drone %d process started (PID: %d)\n",
+                 first_drone, getpid());
+    else
+        snprintf(str, sizeof(str), "Drone group %d-%d process started (PID: %d)\n",
+                 first_drone, first_drone + drone_count - 1, getpid());
     write(STDOUT_FILENO, str, strlen(str));
 
     /* open existing shared memory */
-    if ((fd = shm_open("/drone_sim", O_RDWR, 0)) == -1)
+    if ((fd = shm_open(ipc_names.shm, O_RDWR, 0)) == -1)
     {
         perror("drone shm_open");
         exit(1);
@@ -36,100 +41,182 @@ void drone_process(int drone_id)
     }
 
     /* open semaphores in child process */
-    if ((sem_step_ready = sem_open("/sem_step_ready", 0)) == SEM_FAILED)
+    if ((sem_step_ready = sem_open(ipc_names.sem_step_ready, 0)) == SEM_FAILED)
     {
         perror("drone sem_open step_ready");
         exit(3);
     }
 
-    if ((sem_step_continue = sem_open("/sem_step_continue", 0)) == SEM_FAILED)
+    if ((sem_step_continue = sem_open(ipc_names.sem_step_continue, 0)) == SEM_FAILED)
     {
         perror("drone sem_open step_continue");
         exit(4);
     }
 
-    /* US364: */
-    while (!shm->simulation_finished && shm->drones[drone_id].active)
+    if ((sem_step_continue_odd = sem_open(ipc_names.sem_step_continue_odd, 0)) == SEM_FAILED)
     {
-        if (shm->current_timestep < 0 || shm->current_timestep >= MAX_TIMESTEPS)
-        {
-            snprintf(str, sizeof(str),
-                     "Drone %d: invalid timestep %d\n",
-                     drone_id, shm->current_timestep);
-            write(STDOUT_FILENO, str, strlen(str));
-            break;
-        }
+        perror("drone sem_open step_continue_odd");
+        exit(5);
+    }
 
-        if (shm->current_timestep >= shm->time_steps)
-        {
-            snprintf(str, sizeof(str),
-                     "Drone %d: trajectory completed at timestep %d\n",
-                     drone_id, shm->current_timestep);
-            write(STDOUT_FILENO, str, strlen(str));
-            break;
-        }
+    run_drone_group(first_drone, drone_count, shm);
 
-        update_position(drone_id, shm->current_timestep, shm);
+    /* cleaning up */
+    if (munmap(shm, sizeof(SharedMemory)) == -1)
+    {
+        perror("drone munmap");
+    }
 
-        Position *current_pos = &shm->drones[drone_id].current_pos;
+    if (close(fd) == -1)
+    {
+        perror("drone close");
+    }
 
-        /* validate position */
-        if (!is_valid_position(*current_pos))
-        {
-            shm->drones[drone_id].active = 0;
-            snprintf(str, sizeof(str),
-                     "Drone %d: mission completed (invalid position reached)\n",
-                     drone_id);
-            write(STDOUT_FILENO, str, strlen(str));
-            break;
-        }
+    snprintf(str, sizeof(str), "Drone %d process ending\n", first_drone);
+    write(STDOUT_FILENO, str, strlen(str));
+    exit(0);
+}
+
+/* moves one drone to the current timestep, returns 0 once it stops flying */
+static int step_drone(int drone_id, SharedMemory *shm)
+{
+    char str[200];
 
+    if (shm->current_timestep < 0 || shm->current_timestep >= MAX_TIMESTEPS)
+    {
         snprintf(str, sizeof(str),
-                 "Drone %d: timestep %d, position (%.1f, %.1f, %.1f)\n",
-                 drone_id, shm->current_timestep,
-                 current_pos->x, current_pos->y, current_pos->z);
+                 "Drone %d: invalid timestep %d\n",
+                 drone_id, shm->current_timestep);
         write(STDOUT_FILENO, str, strlen(str));
+        return 0;
+    }
 
-        /* signal ready for next timestep */
-        shm->step_ready[drone_id] = 1;
+    if (shm->current_timestep >= shm->time_steps)
+    {
+        snprintf(str, sizeof(str),
+                 "Drone %d: trajectory completed at timestep %d\n",
+                 drone_id, shm->current_timestep);
+        write(STDOUT_FILENO, str, strlen(str));
+        return 0;
+    }
 
-        /* signal coordinator that this drone is ready */
-        sem_post(sem_step_ready);
+    update_position(drone_id, shm->current_timestep, shm);
 
-        /* block until coordinator signals continue */
-        sem_wait(sem_step_continue);
+    Position *current_pos = &shm->drones[drone_id].current_pos;
 
-        /* acknowledge by clearing ready flag */
-        shm->step_ready[drone_id] = 0;
+    /* validate position */
+    if (!is_valid_position(*current_pos))
+    {
+        shm->drones[drone_id].active = 0;
+        snprintf(str, sizeof(str),
+                 "Drone %d: mission completed (invalid position reached)\n",
+                 drone_id);
+        write(STDOUT_FILENO, str, strlen(str));
+        return 0;
     }
 
-    shm->drones[drone_id].active = 0;
+    snprintf(str, sizeof(str),
+             "Drone %d: timestep %d, position (%.1f, %.1f, %.1f)\n",
+             drone_id, shm->current_timestep,
+             current_pos->x, current_pos->y, current_pos->z);
+    write(STDOUT_FILENO, str, strlen(str));
 
-    /* cleaning up */
-    if (munmap(shm, sizeof(SharedMemory)) == -1)
+    /* signal ready for next timestep */
+    shm->step_ready[drone_id] = 1;
+    return 1;
+}
+
+/* drones are forked in blocks of options.group_size consecutive IDs */
+int drone_group_count(SharedMemory *shm)
+{
+    int size = shm->options.group_size > 0 ? shm->options.group_size : 1;
+    return (shm->num_drones + size - 1) / size;
+}
+
+/* a group takes part in the barrier while any of its drones is flying */
+int count_active_groups(SharedMemory *shm)
+{
+    int g, i, first, last, active = 0;
+    int size = shm->options.group_size > 0 ? shm->options.group_size : 1;
+
+    for (g = 0; g < drone_group_count(shm); g++)
     {
-        perror("drone munmap");
+        first = g * size;
+        last = first + size < shm->num_drones ? first + size : shm->num_drones;
+        for (i = first; i < last; i++)
+        {
+            if (shm->drones[i].active)
+            {
+                active++;
+                break;
+            }
+        }
     }
+    return active;
+}
 
-    if (close(fd) == -1)
+/* US364: step loop of one drone, returns once its mission or the simulation ends */
+void run_drone(int drone_id, SharedMemory *shm)
+{
+    run_drone_group(drone_id, 1, shm);
+}
+
+/* step loop of a block of drones: every drone of the block is moved in turn
+   and the whole block arrives at the barrier once per timestep */
+void run_drone_group(int first_drone, int drone_count, SharedMemory *shm)
+{
+    int i, step, flying = drone_count;
+    int size = shm->options.group_size > 0 ? shm->options.group_size : 1;
+
+    while (!shm->simulation_finished && flying > 0)
     {
-        perror("drone close");
+        step = shm->current_timestep;
+        trace_event(shm, TRACE_DRONES + first_drone / size, TRACE_WAKE, step);
+        flying = 0;
+        for (i = first_drone; i < first_drone + drone_count; i++)
+        {
+            if (!shm->drones[i].active)
+                continue;
+            if (step_drone(i, shm))
+                flying++;
+            else
+                shm->drones[i].active = 0;
+        }
+        if (flying == 0)
+            break;
+
+        /* signal coordinator that this group is ready */
+        trace_event(shm, TRACE_DRONES + first_drone / size, TRACE_ARRIVE, step);
+        sem_post(sem_step_ready);
+
+        /* block until coordinator signals continue; in change-driven
+           stepping the group sleeps until one of its drones moves again */
+        if (shm->options.change_driven)
+            sem_wait(&shm->group_wake[first_drone / size]);
+        else
+            sem_wait(step_continue_semaphore(step));
+
+        /* acknowledge by clearing ready flags */
+        for (i = first_drone; i < first_drone + drone_count; i++)
+        {
+            shm->step_ready[i] = 0;
+        }
     }
 
-    snprintf(str, sizeof(str), "Drone %d process ending\n", drone_id);
-    write(STDOUT_FILENO, str, strlen(str));
-    exit(0);
+    for (i = first_drone; i < first_drone + drone_count; i++)
+    {
+        shm->drones[i].active = 0;
+    }
 }
 
+/* the position comes from the run's storage form: a stored state, an int16
+   state or, with -k, the drone's keyframes evaluated on demand */
 void update_position(int drone_id, int timestep, SharedMemory *shm)
 {
-    if (timestep < shm->time_steps &&
-        shm->time_indexed_states[timestep][drone_id].is_valid)
+    if (timestep < shm->time_steps && is_state_valid(shm, timestep, drone_id))
     {
-        shm->drones[drone_id].current_pos =
-            shm->time_indexed_states[timestep][drone_id].position;
-        shm->drones[drone_id].bounding_box =
-            shm->time_indexed_states[timestep][drone_id].bounding_box;
+        shm->drones[drone_id].current_pos = state_position(shm, timestep, drone_id);
+        shm->drones[drone_id].bounding_box = state_box(shm, timestep, drone_id);
     }
     else
     {
@@ -154,7 +241,16 @@ int check_collision(int drone1_id, int drone2_id, int timestep, SharedMemory *sh
         return 0;
     }
 
-    return shm->collision_matrix[timestep][drone1_id][drone2_id].detected;
+    return pair_detected(shm, timestep, drone1_id, drone2_id);
+}
+
+/* matrix entries left over from an earlier pre-calculation never count, so the
+   matrix is not cleared before a run */
+int pair_detected(SharedMemory *shm, int timestep, int i, int j)
+{
+    CollisionPairState *state = &shm->collision_matrix[timestep][i][j];
+
+    return state->generation == shm->matrix_generation && state->detected;
 }
 
 DroneAABB drone_bounding(Position pos, int drone_size)
@@ -182,4 +278,60 @@ int intersect(DroneAABB box1, DroneAABB box2)
 int is_valid_position(Position pos)
 {
     return !(pos.x == 0.0f && pos.y == 0.0f && pos.z == 0.0f);
-}
\ No newline at end of file
+}
+
+/* boxes of equal size overlap when every centre distance is within one box size */
+int intersect_quantised(QuantisedState a, QuantisedState b, int size)
+{
+    return (abs(a.x - b.x) <= size &&
+            abs(a.y - b.y) <= size &&
+            abs(a.z - b.z) <= size);
+}
+
+Position dequantise_position(QuantisedState q, float scale)
+{
+    Position pos;
+
+    pos.x = q.x * scale;
+    pos.y = q.y * scale;
+    pos.z = q.z * scale;
+
+    return pos;
+}
+
+int is_state_valid(SharedMemory *shm, int timestep, int drone_id)
+{
+    if (shm->options.keyframes)
+    {
+        return is_valid_position(trajectory_position(shm, drone_id, timestep));
+    }
+    if (shm->options.quantised_states)
+    {
+        return shm->quantised_states[timestep][drone_id].is_valid;
+    }
+    return shm->time_indexed_states[timestep][drone_id].is_valid;
+}
+
+Position state_position(SharedMemory *shm, int timestep, int drone_id)
+{
+    if (shm->options.keyframes)
+    {
+        return trajectory_position(shm, drone_id, timestep);
+    }
+    if (shm->options.quantised_states)
+    {
+        return dequantise_position(shm->quantised_states[timestep][drone_id],
+                                   shm->quantisation_scale);
+    }
+    return shm->time_indexed_states[timestep][drone_id].position;
+}
+
+/* only float states store their box, the other forms derive it */
+DroneAABB state_box(SharedMemory *shm, int timestep, int drone_id)
+{
+    if (!shm->options.keyframes && !shm->options.quantised_states)
+    {
+        return shm->time_indexed_states[timestep][drone_id].bounding_box;
+    }
+    return drone_bounding(state_position(shm, timestep, drone_id), shm->drone_size);
+}
@@ -0,0 +1,230 @@
+#include "../includes/simulation.h"
+
+/* uniform grid over the environment boxes, built once at startup; every cell
+   keeps a bit mask of the boxes that overlap it (MAX_ENV_BOXES <= 64) */
+static uint64_t env_grid[ENV_GRID_CELLS][ENV_GRID_CELLS][ENV_GRID_CELLS];
+static DroneAABB env_bounds;
+static float env_cell_x, env_cell_y, env_cell_z;
+
+static const char *environment_type_name(int type)
+{
+    switch (type)
+    {
+    case ENV_NOFLY:
+        return "no-fly zone";
+    case ENV_GROUND:
+        return "ground limit";
+    default:
+        return "obstacle";
+    }
+}
+
+/* box types of environment.csv, -1 for an unknown type */
+static int environment_type_of(const char *name)
+{
+    if (strcmp(name, "obstacle") == 0)
+        return ENV_OBSTACLE;
+    if (strcmp(name, "nofly") == 0)
+        return ENV_NOFLY;
+    return -1;
+}
+
+/* cell index of a coordinate along one axis, clamped to the grid */
+static int env_cell(float value, float min, float cell)
+{
+    int c = (int)((value - min) / cell);
+    if (c < 0)
+        return 0;
+    if (c >= ENV_GRID_CELLS)
+        return ENV_GRID_CELLS - 1;
+    return c;
+}
+
+static void build_environment_index(SharedMemory *shm)
+{
+    int b, x, y, z;
+
+    memset(env_grid, 0, sizeof(env_grid));
+    if (shm->environment_count == 0)
+        return;
+
+    env_bounds = shm->environment[0].box;
+    for (b = 1; b < shm->environment_count; b++)
+    {
+        DroneAABB *box = &shm->environment[b].box;
+        env_bounds.minX = fminf(env_bounds.minX, box->minX);
+        env_bounds.maxX = fmaxf(env_bounds.maxX, box->maxX);
+        env_bounds.minY = fminf(env_bounds.minY, box->minY);
+        env_bounds.maxY = fmaxf(env_bounds.maxY, box->maxY);
+        env_bounds.minZ = fminf(env_bounds.minZ, box->minZ);
+        env_bounds.maxZ = fmaxf(env_bounds.maxZ, box->maxZ);
+    }
+
+    env_cell_x = fmaxf((env_bounds.maxX - env_bounds.minX) / ENV_GRID_CELLS, 1e-3f);
+    env_cell_y = fmaxf((env_bounds.maxY - env_bounds.minY) / ENV_GRID_CELLS, 1e-3f);
+    env_cell_z = fmaxf((env_bounds.maxZ - env_bounds.minZ) / ENV_GRID_CELLS, 1e-3f);
+
+    for (b = 0; b < shm->environment_count; b++)
+    {
+        DroneAABB *box = &shm->environment[b].box;
+        for (x = env_cell(box->minX, env_bounds.minX, env_cell_x); x <= env_cell(box->maxX, env_bounds.minX, env_cell_x); x++)
+            for (y = env_cell(box->minY, env_bounds.minY, env_cell_y); y <= env_cell(box->maxY, env_bounds.minY, env_cell_y); y++)
+                for (z = env_cell(box->minZ, env_bounds.minZ, env_cell_z); z <= env_cell(box->maxZ, env_bounds.minZ, env_cell_z); z++)
+                    env_grid[x][y][z] |= (uint64_t)1 << b;
+    }
+}
+
+/* reads <data_dir>/environment.csv, one entry per line:
+   obstacle,minX,maxX,minY,maxY,minZ,maxZ
+   nofly,minX,maxX,minY,maxY,minZ,maxZ
+   ground,z
+   the file is optional, a missing file means an empty environment */
+void load_environment(SharedMemory *shm)
+{
+    char path[300], line[256], type[16], str[400];
+    DroneAABB box;
+    int type_id;
+    FILE *fp;
+
+    shm->environment_count = 0;
+    shm->has_ground_limit = 0;
+    shm->env_hit_count = 0;
+    shm->env_hits_dropped = 0;
+
+    snprintf(path, sizeof(path), ENVIRONMENT_PATH_FORMAT, shm->options.data_dir);
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        build_environment_index(shm);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        if (sscanf(line, "ground,%f", &shm->ground_level) == 1)
+        {
+            shm->has_ground_limit = 1;
+            continue;
+        }
+
+        if (sscanf(line, "%15[^,],%f,%f,%f,%f,%f,%f", type,
+                   &box.minX, &box.maxX, &box.minY, &box.maxY, &box.minZ, &box.maxZ) != 7 ||
+            (type_id = environment_type_of(type)) < 0)
+        {
+            snprintf(str, sizeof(str), "Warning: Invalid environment line ignored: %s", line);
+            write(STDOUT_FILENO, str, strlen(str));
+            continue;
+        }
+
+        if (shm->environment_count >= MAX_ENV_BOXES)
+        {
+            snprintf(str, sizeof(str), "Warning: More than %d environment boxes, rest ignored\n", MAX_ENV_BOXES);
+            write(STDOUT_FILENO, str, strlen(str));
+            break;
+        }
+
+        shm->environment[shm->environment_count].type = type_id;
+        shm->environment[shm->environment_count].box = box;
+        shm->environment_count++;
+    }
+    fclose(fp);
+
+    build_environment_index(shm);
+
+    snprintf(str, sizeof(str), "Loaded environment from %s (%d boxes%s)\n", path,
+             shm->environment_count, shm->has_ground_limit ? ", ground limit" : "");
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+static void record_environment_hit(SharedMemory *shm, int timestep, int drone_id,
+                                   int env_id, int type, Position pos)
+{
+    char str[200];
+    EnvironmentHit *hit;
+
+    if (shm->env_hit_count >= MAX_ENV_HITS)
+    {
+        shm->env_hits_dropped++;
+        return;
+    }
+
+    hit = &shm->env_hits[shm->env_hit_count++];
+    hit->timestep = timestep;
+    hit->drone_id = drone_id;
+    hit->env_id = env_id;
+    hit->type = type;
+    hit->pos = pos;
+
+    snprintf(str, sizeof(str), "EDrone %d hits %s %d at timestep %d pos(%.1f,%.1f,%.1f)\n",
+             drone_id, environment_type_name(type), env_id, timestep, pos.x, pos.y, pos.z);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* drone-vs-environment test of one drone state, called from the precompute scan */
+void check_environment(SharedMemory *shm, int timestep, int drone_id, Position pos, DroneAABB box)
+{
+    uint64_t candidates = 0;
+    int x, y, z, b;
+
+    if (shm->has_ground_limit && box.minZ < shm->ground_level)
+    {
+        record_environment_hit(shm, timestep, drone_id, -1, ENV_GROUND, pos);
+    }
+
+    if (shm->environment_count == 0 || !intersect(box, env_bounds))
+        return;
+
+    for (x = env_cell(box.minX, env_bounds.minX, env_cell_x); x <= env_cell(box.maxX, env_bounds.minX, env_cell_x); x++)
+        for (y = env_cell(box.minY, env_bounds.minY, env_cell_y); y <= env_cell(box.maxY, env_bounds.minY, env_cell_y); y++)
+            for (z = env_cell(box.minZ, env_bounds.minZ, env_cell_z); z <= env_cell(box.maxZ, env_bounds.minZ, env_cell_z); z++)
+                candidates |= env_grid[x][y][z];
+
+    while (candidates)
+    {
+        b = __builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+        if (intersect(box, shm->environment[b].box))
+        {
+            record_environment_hit(shm, timestep, drone_id, b, shm->environment[b].type, pos);
+        }
+    }
+}
+
+void report_environment_hits(SharedMemory *shm, FILE *report_file)
+{
+    int i, reached = 0;
+
+    fprintf(report_file, "\nENVIRONMENT HITS:\n");
+    fprintf(report_file, "- Environment: %d boxes%s\n", shm->environment_count,
+            shm->has_ground_limit ? " and a ground limit" : "");
+    for (i = 0; i < shm->env_hit_count; i++)
+    {
+        EnvironmentHit *hit = &shm->env_hits[i];
+        if (hit->timestep > last_counted_step(shm))
+            continue;
+        reached++;
+        if (hit->type == ENV_GROUND)
+        {
+            fprintf(report_file, "Hit %d: timestep %d, drone %d below ground limit %.1f at (%.1f, %.1f, %.1f)\n",
+                    reached, hit->timestep, hit->drone_id, shm->ground_level,
+                    hit->pos.x, hit->pos.y, hit->pos.z);
+        }
+        else
+        {
+            fprintf(report_file, "Hit %d: timestep %d, drone %d inside %s %d at (%.1f, %.1f, %.1f)\n",
+                    reached, hit->timestep, hit->drone_id, environment_type_name(hit->type),
+                    hit->env_id, hit->pos.x, hit->pos.y, hit->pos.z);
+        }
+    }
+    if (reached == 0)
+    {
+        fprintf(report_file, "- No environment hits.\n");
+    }
+    if (shm->env_hits_dropped > 0)
+    {
+        fprintf(report_file, "- %d further hits not stored (limit %d)\n",
+                shm->env_hits_dropped, MAX_ENV_HITS);
+    }
+}
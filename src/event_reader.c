@@ -0,0 +1,361 @@
+#include "../includes/simulation.h"
+
+/* offline reader for the binary event log written with ./drone -L, answers
+   drone/timestep range queries through an index kept next to the log */
+
+#define INDEX_MAGIC 0x58444e49
+#define INDEX_SUFFIX ".idx"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t log_size;
+    uint64_t entry_count;
+} IndexHeader;
+
+/* one entry per drone of every collision and one (drone_id -1) per step summary */
+typedef struct
+{
+    int32_t drone_id;
+    int32_t timestep;
+    int32_t run;
+    int32_t type;
+    uint64_t offset;
+} IndexEntry;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const IndexEntry *x = a, *y = b;
+
+    if (x->drone_id != y->drone_id)
+        return x->drone_id < y->drone_id ? -1 : 1;
+    if (x->timestep != y->timestep)
+        return x->timestep < y->timestep ? -1 : 1;
+    if (x->run != y->run)
+        return x->run < y->run ? -1 : 1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static int add_entry(IndexEntry **entries, size_t *count, size_t *capacity, IndexEntry entry)
+{
+    if (*count == *capacity)
+    {
+        size_t grown = *capacity ? *capacity * 2 : 1024;
+        IndexEntry *bigger = realloc(*entries, grown * sizeof(IndexEntry));
+        if (bigger == NULL)
+        {
+            perror("realloc");
+            return -1;
+        }
+        *entries = bigger;
+        *capacity = grown;
+    }
+    (*entries)[(*count)++] = entry;
+    return 0;
+}
+
+/* the payload of the record at offset when it is complete and holds at least
+   payload_size bytes, NULL for a short or truncated record */
+static const char *record_payload(const char *log, size_t log_size, size_t offset, size_t payload_size)
+{
+    EventRecordHeader header;
+
+    if (offset > log_size || log_size - offset < sizeof(header))
+        return NULL;
+    memcpy(&header, log + offset, sizeof(header));
+    if (header.size < payload_size || log_size - offset - sizeof(header) < header.size)
+        return NULL;
+    return log + offset + sizeof(header);
+}
+
+/* a run record written by this version of ./drone -L */
+static int valid_run_record(const char *log, size_t log_size, size_t offset)
+{
+    const char *payload = record_payload(log, log_size, offset, sizeof(RunRecord));
+    EventRecordHeader header;
+    RunRecord record;
+
+    if (payload == NULL)
+        return 0;
+    memcpy(&header, log + offset, sizeof(header));
+    memcpy(&record, payload, sizeof(record));
+    return header.type == EVENT_RUN && record.magic == EVENT_LOG_MAGIC &&
+           record.version == EVENT_LOG_VERSION;
+}
+
+/* one pass over the log, then sort by drone and timestep */
+static IndexEntry *build_index(const char *log, size_t log_size, size_t *count)
+{
+    IndexEntry *entries = NULL, entry;
+    size_t capacity = 0, offset = 0;
+    int run = -1;
+
+    *count = 0;
+    while (offset + sizeof(EventRecordHeader) <= log_size)
+    {
+        EventRecordHeader header;
+        memcpy(&header, log + offset, sizeof(header));
+        if (header.size > log_size - offset - sizeof(header))
+        {
+            fprintf(stderr, "Warning: truncated record at offset %zu\n", offset);
+            break;
+        }
+
+        entry.run = run;
+        entry.type = header.type;
+        entry.offset = offset;
+
+        if (header.type == EVENT_RUN)
+        {
+            /* a run written by another version can not be decoded, and
+               nothing after it can be trusted */
+            if (!valid_run_record(log, log_size, offset))
+            {
+                fprintf(stderr, "Warning: invalid run record at offset %zu, indexing stopped\n", offset);
+                break;
+            }
+            run++;
+        }
+        else if ((header.type == EVENT_STEP && header.size < sizeof(StepSummaryRecord)) ||
+                 (header.type == EVENT_COLLISION && header.size < sizeof(CollisionEvent)))
+        {
+            fprintf(stderr, "Warning: short record at offset %zu skipped\n", offset);
+        }
+        else if (header.type == EVENT_STEP)
+        {
+            StepSummaryRecord step;
+            memcpy(&step, log + offset + sizeof(header), sizeof(step));
+            entry.drone_id = -1;
+            entry.timestep = step.timestep;
+            if (add_entry(&entries, count, &capacity, entry) == -1)
+                break;
+        }
+        else if (header.type == EVENT_COLLISION)
+        {
+            CollisionEvent collision;
+            memcpy(&collision, log + offset + sizeof(header), sizeof(collision));
+            entry.timestep = collision.timestep;
+            entry.drone_id = collision.drone1_id;
+            if (add_entry(&entries, count, &capacity, entry) == -1)
+                break;
+            entry.drone_id = collision.drone2_id;
+            if (add_entry(&entries, count, &capacity, entry) == -1)
+                break;
+        }
+
+        offset += sizeof(header) + header.size;
+    }
+
+    qsort(entries, *count, sizeof(IndexEntry), compare_entries);
+    return entries;
+}
+
+/* reuses <log>.idx when it was built for a log of the same size */
+static IndexEntry *load_index(const char *index_path, size_t log_size, size_t *count)
+{
+    IndexHeader header;
+    IndexEntry *entries;
+    FILE *fp;
+
+    if ((fp = fopen(index_path, "rb")) == NULL)
+        return NULL;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != INDEX_MAGIC || header.version != EVENT_LOG_VERSION ||
+        header.log_size != log_size)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    entries = malloc(header.entry_count * sizeof(IndexEntry) + 1);
+    if (entries == NULL || fread(entries, sizeof(IndexEntry), header.entry_count, fp) != header.entry_count)
+    {
+        free(entries);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *count = header.entry_count;
+    return entries;
+}
+
+static void save_index(const char *index_path, size_t log_size, IndexEntry *entries, size_t count)
+{
+    IndexHeader header;
+    FILE *fp;
+
+    if ((fp = fopen(index_path, "wb")) == NULL)
+    {
+        perror("fopen index");
+        return;
+    }
+
+    header.magic = INDEX_MAGIC;
+    header.version = EVENT_LOG_VERSION;
+    header.log_size = log_size;
+    header.entry_count = count;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(entries, sizeof(IndexEntry), count, fp) != count)
+    {
+        perror("fwrite index");
+    }
+    fclose(fp);
+}
+
+/* first entry not ordered before (drone_id, timestep) */
+static size_t lower_bound(IndexEntry *entries, size_t count, int drone_id, int timestep)
+{
+    size_t low = 0, high = count;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].drone_id < drone_id ||
+            (entries[mid].drone_id == drone_id && entries[mid].timestep < timestep))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/* prints the record an index entry points to, returns 0 when the index no
+   longer matches the log there */
+static int print_record(const char *log, size_t log_size, IndexEntry *entry)
+{
+    size_t payload_size = entry->type == EVENT_STEP ? sizeof(StepSummaryRecord) : sizeof(CollisionEvent);
+    const char *payload = record_payload(log, log_size, entry->offset, payload_size);
+    EventRecordHeader header;
+
+    if (payload != NULL)
+        memcpy(&header, log + entry->offset, sizeof(header));
+    if (payload == NULL || header.type != (uint32_t)entry->type)
+    {
+        fprintf(stderr, "Warning: index entry at offset %llu does not match the log, rebuild with -i\n",
+                (unsigned long long)entry->offset);
+        return 0;
+    }
+
+    if (entry->type == EVENT_STEP)
+    {
+        StepSummaryRecord step;
+        memcpy(&step, payload, sizeof(step));
+        printf("run %d step %d: active drones %d, collisions %d, latency %.1f us\n",
+               entry->run, step.timestep, step.active_drones, step.collision_count,
+               step.latency * 1e6);
+    }
+    else
+    {
+        CollisionEvent c;
+        memcpy(&c, payload, sizeof(c));
+        printf("run %d step %.3f: drones %d and %d at (%.1f, %.1f, %.1f) and (%.1f, %.1f, %.1f)\n",
+               entry->run, c.time, c.drone1_id, c.drone2_id,
+               c.pos1.x, c.pos1.y, c.pos1.z, c.pos2.x, c.pos2.y, c.pos2.z);
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *log_path = DEFAULT_EVENT_LOG;
+    char index_path[300];
+    int opt, drone_id = -2, first = 0, last = MAX_TIMESTEPS, run = -1, rebuild = 0, matches = 0;
+    struct stat st;
+    IndexEntry *entries;
+    size_t count, i;
+    char *log;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "d:s:e:r:Si")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            drone_id = atoi(optarg);
+            break;
+        case 's':
+            first = atoi(optarg);
+            break;
+        case 'e':
+            last = atoi(optarg);
+            break;
+        case 'r':
+            run = atoi(optarg);
+            break;
+        case 'S':
+            drone_id = -1;
+            break;
+        case 'i':
+            rebuild = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s (-d drone | -S) [-s first] [-e last] [-r run] [-i] [log]\n", argv[0]);
+            fprintf(stderr, "  -d  events involving this drone\n");
+            fprintf(stderr, "  -S  per-step summaries instead of collision events\n");
+            fprintf(stderr, "  -s/-e  inclusive timestep range\n");
+            fprintf(stderr, "  -r  only this run of the log (0 is the first)\n");
+            fprintf(stderr, "  -i  rebuild the index even if it is up to date\n");
+            exit(1);
+        }
+    }
+    if (optind < argc)
+        log_path = argv[optind];
+
+    if (drone_id == -2)
+    {
+        fprintf(stderr, "Select a drone with -d or step summaries with -S\n");
+        exit(1);
+    }
+
+    if ((fd = open(log_path, O_RDONLY)) == -1)
+    {
+        perror("open log");
+        exit(2);
+    }
+    if (fstat(fd, &st) == -1)
+    {
+        perror("fstat");
+        exit(3);
+    }
+    if (st.st_size == 0)
+    {
+        printf("Empty log\n");
+        return 0;
+    }
+    if ((log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(4);
+    }
+
+    if (!valid_run_record(log, st.st_size, 0))
+    {
+        fprintf(stderr, "%s is not an event log of this version (no valid run record)\n", log_path);
+        exit(5);
+    }
+
+    snprintf(index_path, sizeof(index_path), "%s%s", log_path, INDEX_SUFFIX);
+    entries = rebuild ? NULL : load_index(index_path, st.st_size, &count);
+    if (entries == NULL)
+    {
+        entries = build_index(log, st.st_size, &count);
+        save_index(index_path, st.st_size, entries, count);
+    }
+
+    for (i = lower_bound(entries, count, drone_id, first);
+         i < count && entries[i].drone_id == drone_id && entries[i].timestep <= last; i++)
+    {
+        if (run >= 0 && entries[i].run != run)
+            continue;
+        matches += print_record(log, st.st_size, &entries[i]);
+    }
+    printf("%d matching records\n", matches);
+
+    free(entries);
+    munmap(log, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "../includes/simulation.h"
+
+/* append-only binary event log of the coordinator process, records are
+   collected in a large buffer and written with a single write() when it fills */
+static int log_fd = -1;
+static char log_buffer[EVENT_LOG_BUFFER_SIZE];
+static size_t log_used = 0;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void flush_event_log(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < log_used)
+    {
+        if ((n = write(log_fd, log_buffer + done, log_used - done)) == -1)
+        {
+            perror("write event log");
+            break;
+        }
+        done += n;
+    }
+    log_used = 0;
+}
+
+static void append_record(uint32_t type, const void *data, uint32_t size)
+{
+    EventRecordHeader header;
+
+    if (log_fd == -1)
+        return;
+
+    header.type = type;
+    header.size = size;
+
+    pthread_mutex_lock(&log_mutex);
+    if (log_used + sizeof(header) + size > sizeof(log_buffer))
+    {
+        flush_event_log();
+    }
+    memcpy(log_buffer + log_used, &header, sizeof(header));
+    memcpy(log_buffer + log_used + sizeof(header), data, size);
+    log_used += sizeof(header) + size;
+    pthread_mutex_unlock(&log_mutex);
+}
+
+/* opens the log for appending and starts a new run in it */
+void open_event_log(SharedMemory *shm)
+{
+    RunRecord run;
+    char str[400];
+
+    if (shm->options.event_log_path[0] == '\0')
+        return;
+
+    if ((log_fd = open(shm->options.event_log_path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1)
+    {
+        perror("open event log");
+        return;
+    }
+
+    memset(&run, 0, sizeof(run));
+    run.magic = EVENT_LOG_MAGIC;
+    run.version = EVENT_LOG_VERSION;
+    run.num_drones = shm->num_drones;
+    run.drone_size = shm->drone_size;
+    run.max_collisions = shm->max_collisions;
+    run.time_steps = shm->time_steps;
+    run.start_time = (int64_t)time(NULL);
+    append_record(EVENT_RUN, &run, sizeof(run));
+
+    snprintf(str, sizeof(str), "Appending events to %s\n", shm->options.event_log_path);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+void log_step_summary(PipelineSlot *slot)
+{
+    StepSummaryRecord step;
+
+    step.timestep = slot->timestep;
+    step.active_drones = slot->active_drones;
+    step.collision_count = slot->collision_count;
+    step.latency = slot->latency;
+    append_record(EVENT_STEP, &step, sizeof(step));
+}
+
+void log_collision_event(CollisionEvent *collision)
+{
+    append_record(EVENT_COLLISION, collision, sizeof(*collision));
+}
+
+void close_event_log(void)
+{
+    if (log_fd == -1)
+        return;
+
+    pthread_mutex_lock(&log_mutex);
+    flush_event_log();
+    pthread_mutex_unlock(&log_mutex);
+
+    if (close(log_fd) == -1)
+    {
+        perror("close event log");
+    }
+    log_fd = -1;
+}
@@ -0,0 +1,228 @@
+#include "../includes/simulation.h"
+
+/* in-process evaluation of the patterns of scripts/movement_script.sh, a figure
+   file holds one line per drone instead of one line per drone per timestep:
+     <drone> linear      start_x start_y start_z x_inc y_inc z_inc
+     <drone> circular    center_x center_y z radius direction
+     <drone> spiral      center_x center_y start_z radius z_inc
+     <drone> oscillating center_x center_y center_z amplitude_x amplitude_y amplitude_z
+   drones are numbered from 1 like the movement files */
+
+/* the script's pi (3.14159) in units of 1e-5, and its angle precision: bc
+   truncates every division to the current scale (6 digits for the angle, 1 for
+   the spiral's radius growth, 0 inside the coordinate expressions) */
+#define FIGURE_PI_E5 314159LL
+#define FIGURE_ANGLE_SCALE 1e6
+#define FIGURE_RADIUS_SCALE 10
+
+/* parameters kept per pattern as separate arrays so each pattern is a
+   branch-free loop over its drones */
+typedef struct
+{
+    int count;
+    int drone[MAX_DRONES];
+    double p[6][MAX_DRONES];
+} PatternGroup;
+
+typedef struct
+{
+    SharedMemory *shm;
+    PatternGroup *groups;
+    Position (*staged)[MAX_TIMESTEPS]; /* -k: samples kept out of shared memory */
+    int first_step;
+    int last_step;
+} FigureChunk;
+
+/* parameters each pattern's figure line carries, indexed by FIGURE_* */
+static const int pattern_parameters[FIGURE_PATTERNS] = {6, 5, 5, 6};
+
+static int pattern_of(const char *name)
+{
+    if (strcmp(name, "linear") == 0)
+        return FIGURE_LINEAR;
+    if (strcmp(name, "circular") == 0)
+        return FIGURE_CIRCULAR;
+    if (strcmp(name, "spiral") == 0)
+        return FIGURE_SPIRAL;
+    if (strcmp(name, "oscillating") == 0)
+        return FIGURE_OSCILLATING;
+    return -1;
+}
+
+static void store_position(FigureChunk *chunk, int drone_id, int t, double x, double y, double z)
+{
+    SharedMemory *shm = chunk->shm;
+    Position *pos = chunk->staged ? &chunk->staged[drone_id][t] : &shm->drones[drone_id].trajectory[t];
+
+    /* the script truncates every coordinate to the integer grid */
+    pos->x = (float)trunc(x);
+    pos->y = (float)trunc(y);
+    pos->z = (float)trunc(z);
+
+    /* quantised states and keyframes are derived after loading */
+    if (!shm->options.quantised_states && !shm->options.keyframes)
+    {
+        TimeIndexedDroneState *state = &shm->time_indexed_states[t][drone_id];
+        state->is_valid = is_valid_position(*pos);
+        state->position = *pos;
+        state->bounding_box = drone_bounding(*pos, shm->drone_size);
+    }
+}
+
+/* one thread evaluates every drone over a range of timesteps */
+static void *evaluate_figure_chunk(void *arg)
+{
+    FigureChunk *chunk = (FigureChunk *)arg;
+    SharedMemory *shm = chunk->shm;
+    PatternGroup *g;
+    int t, k;
+
+    for (t = chunk->first_step; t < chunk->last_step; t++)
+    {
+        /* t*2*3.14159/STEPS at scale=6, done in integers so the truncation
+           does not depend on the rounding of 3.14159 as a double */
+        double angle = (t * 2 * FIGURE_PI_E5 * 10 / shm->time_steps) / FIGURE_ANGLE_SCALE;
+        double cos_a = cos(angle), sin_a = sin(angle);
+
+        g = &chunk->groups[FIGURE_LINEAR];
+        for (k = 0; k < g->count; k++)
+        {
+            store_position(chunk, g->drone[k], t,
+                           g->p[0][k] + t * g->p[3][k],
+                           g->p[1][k] + t * g->p[4][k],
+                           g->p[2][k] + t * g->p[5][k]);
+        }
+
+        g = &chunk->groups[FIGURE_CIRCULAR];
+        for (k = 0; k < g->count; k++)
+        {
+            /* direction is +1 or -1 and bc truncates toward zero, so only the
+               sine changes sign */
+            store_position(chunk, g->drone[k], t,
+                           g->p[0][k] + g->p[3][k] * cos_a,
+                           g->p[1][k] + g->p[3][k] * sin_a * g->p[4][k],
+                           g->p[2][k]);
+        }
+
+        g = &chunk->groups[FIGURE_SPIRAL];
+        for (k = 0; k < g->count; k++)
+        {
+            /* scale=1: t/(STEPS*2) is truncated to one decimal */
+            double r = g->p[3][k] * (1 + (double)(t * FIGURE_RADIUS_SCALE / (shm->time_steps * 2)) /
+                                             FIGURE_RADIUS_SCALE);
+            store_position(chunk, g->drone[k], t,
+                           g->p[0][k] + r * cos_a,
+                           g->p[1][k] + r * sin_a,
+                           g->p[2][k] + t * g->p[4][k]);
+        }
+
+        g = &chunk->groups[FIGURE_OSCILLATING];
+        for (k = 0; k < g->count; k++)
+        {
+            store_position(chunk, g->drone[k], t,
+                           g->p[0][k] + g->p[3][k] * cos_a,
+                           g->p[1][k] + g->p[4][k] * sin(angle * 2),
+                           /* angle/2 runs at the coordinate's scale=0 */
+                           g->p[2][k] + g->p[5][k] * sin(trunc(angle / 2)));
+        }
+    }
+
+    return NULL;
+}
+
+/* reads the figure file and evaluates it straight into the trajectories and
+   time-indexed states, or with -k into a private buffer that is compressed to
+   keyframes; returns 0 when the file cannot be read */
+int load_figure(SharedMemory *shm)
+{
+    PatternGroup groups[FIGURE_PATTERNS];
+    FigureChunk chunks[MAX_PARALLEL_THREADS];
+    Position(*staged)[MAX_TIMESTEPS] = NULL;
+    int described[MAX_DRONES] = {0};
+    char line[256], name[16], str[400];
+    double p[6];
+    int drone, pattern, n, i, t, thread_count;
+    FILE *fp;
+
+    if ((fp = fopen(shm->options.figure_path, "r")) == NULL)
+    {
+        perror("fopen figure");
+        return 0;
+    }
+
+    memset(groups, 0, sizeof(groups));
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        memset(p, 0, sizeof(p));
+        n = sscanf(line, "%d %15s %lf %lf %lf %lf %lf %lf", &drone, name,
+                   &p[0], &p[1], &p[2], &p[3], &p[4], &p[5]);
+        pattern = n >= 2 ? pattern_of(name) : -1;
+        if (pattern < 0 || n != 2 + pattern_parameters[pattern] || drone < 1 || drone > shm->num_drones)
+        {
+            snprintf(str, sizeof(str), "Warning: Invalid figure line ignored: %s", line);
+            write(STDOUT_FILENO, str, strlen(str));
+            continue;
+        }
+        /* one line per drone, which also bounds every group at num_drones */
+        if (described[drone - 1])
+        {
+            snprintf(str, sizeof(str), "Warning: Repeated figure entry for drone %d ignored\n", drone);
+            write(STDOUT_FILENO, str, strlen(str));
+            continue;
+        }
+
+        PatternGroup *g = &groups[pattern];
+        g->drone[g->count] = drone - 1;
+        for (i = 0; i < 6; i++)
+            g->p[i][g->count] = p[i];
+        g->count++;
+        described[drone - 1] = 1;
+    }
+    fclose(fp);
+
+    if (shm->options.keyframes && !(staged = malloc(MAX_DRONES * sizeof(*staged))))
+    {
+        perror("malloc figure samples");
+        return 0;
+    }
+
+    thread_count = parallel_thread_count(shm->time_steps);
+    for (i = 0; i < thread_count; i++)
+    {
+        chunks[i].shm = shm;
+        chunks[i].groups = groups;
+        chunks[i].staged = staged;
+        chunks[i].first_step = shm->time_steps * i / thread_count;
+        chunks[i].last_step = shm->time_steps * (i + 1) / thread_count;
+    }
+
+    /* drones without a line never become valid */
+    for (drone = 0; drone < shm->num_drones; drone++)
+    {
+        if (described[drone])
+            continue;
+        snprintf(str, sizeof(str), "Warning: No figure entry for drone %d\n", drone + 1);
+        write(STDOUT_FILENO, str, strlen(str));
+        for (t = 0; t < shm->time_steps; t++)
+            store_position(&chunks[0], drone, t, 0.0, 0.0, 0.0);
+    }
+
+    run_parallel_chunks(evaluate_figure_chunk, chunks, thread_count, sizeof(FigureChunk));
+
+    if (staged)
+    {
+        for (drone = 0; drone < shm->num_drones; drone++)
+            store_keyframes(shm, drone, staged[drone]);
+        free(staged);
+    }
+
+    shm->pre_calculation_complete = !shm->options.quantised_states && !shm->options.keyframes;
+
+    snprintf(str, sizeof(str), "Evaluated figure %s for %d drones across %d timesteps (%d threads)\n",
+             shm->options.figure_path, shm->num_drones, shm->time_steps, thread_count);
+    write(STDOUT_FILENO, str, strlen(str));
+    return 1;
+}
@@ -0,0 +1,198 @@
+#include "../includes/simulation.h"
+#include <errno.h>
+#include <stddef.h>
+
+/* names of every IPC object of this run, "/drone_sim" style names without a
+   run ID and "/drone_sim.<run_id>" style names with one */
+IpcNames ipc_names;
+
+void set_ipc_namespace(const char *run_id)
+{
+    const char *dot = run_id[0] ? "." : "";
+
+    snprintf(ipc_names.run_id, sizeof(ipc_names.run_id), "%s", run_id);
+    snprintf(ipc_names.shm, sizeof(ipc_names.shm), SHM_NAME "%s%s", dot, run_id);
+    snprintf(ipc_names.sem_step_ready, sizeof(ipc_names.sem_step_ready),
+             "/sem_step_ready%s%s", dot, run_id);
+    snprintf(ipc_names.sem_step_continue, sizeof(ipc_names.sem_step_continue),
+             "/sem_step_continue%s%s", dot, run_id);
+    snprintf(ipc_names.sem_step_continue_odd, sizeof(ipc_names.sem_step_continue_odd),
+             "/sem_step_continue_odd%s%s", dot, run_id);
+    snprintf(ipc_names.sem_pool_start, sizeof(ipc_names.sem_pool_start),
+             "/sem_pool_start%s%s", dot, run_id);
+    snprintf(ipc_names.sem_pool_idle, sizeof(ipc_names.sem_pool_idle),
+             "/sem_pool_idle%s%s", dot, run_id);
+    snprintf(ipc_names.pool_socket, sizeof(ipc_names.pool_socket),
+             "%s%s%s", POOL_SOCKET_PATH, dot, run_id);
+    snprintf(ipc_names.create_lock, sizeof(ipc_names.create_lock),
+             "%s%s%s.lock", CREATE_LOCK_PATH, dot, run_id);
+}
+
+/* called with the namespace's create lock held when its shared memory already
+   exists: if the PID that created it is gone, every object of the namespace is
+   removed and 1 is returned so the caller can retry, 0 if the namespace is
+   really in use; creators publish owner_pid before releasing the lock, so an
+   owner of 0 here means the creator died before it got that far */
+int recover_stale_ipc(void)
+{
+    pid_t owner = 0;
+    char str[300];
+    int fd;
+
+    if ((fd = shm_open(ipc_names.shm, O_RDONLY, 0)) == -1)
+    {
+        /* removed in the meantime */
+        return errno == ENOENT;
+    }
+    if (pread(fd, &owner, sizeof(owner), offsetof(SharedMemory, owner_pid)) != sizeof(owner))
+    {
+        owner = 0;
+    }
+    close(fd);
+
+    if (owner > 0 && (kill(owner, 0) == 0 || errno != ESRCH))
+    {
+        snprintf(str, sizeof(str), "Run '%s' is in use by PID %d (shared memory %s)\n",
+                 ipc_names.run_id, owner, ipc_names.shm);
+        write(STDOUT_FILENO, str, strlen(str));
+        return 0;
+    }
+
+    shm_unlink(ipc_names.shm);
+    sem_unlink(ipc_names.sem_step_ready);
+    sem_unlink(ipc_names.sem_step_continue);
+    sem_unlink(ipc_names.sem_step_continue_odd);
+    sem_unlink(ipc_names.sem_pool_start);
+    sem_unlink(ipc_names.sem_pool_idle);
+    unlink(ipc_names.pool_socket);
+
+    snprintf(str, sizeof(str), "Recovered stale IPC objects of run '%s' (owner PID %d is gone)\n",
+             ipc_names.run_id, owner);
+    write(STDOUT_FILENO, str, strlen(str));
+    return 1;
+}
+
+/* drones released after timestep t wait on the semaphore of t's parity, so a
+   drone that is already waiting for the next release can never take a token
+   meant for a drone that has not woken up yet */
+sem_t *step_continue_semaphore(int timestep)
+{
+    return (timestep % 2) ? sem_step_continue_odd : sem_step_continue;
+}
+
+/* -H: asks for transparent huge pages on the shared segment; for POSIX shared
+   memory the kernel only honours it when shmem_enabled allows it */
+void advise_shared_memory(SharedMemory *shm)
+{
+    char setting[100] = "", str[200];
+    FILE *fp;
+
+    if (!shm->options.huge_pages)
+        return;
+
+    if (madvise(shm, sizeof(SharedMemory), MADV_HUGEPAGE) == -1)
+    {
+        perror("madvise MADV_HUGEPAGE");
+        return;
+    }
+    if ((fp = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r")))
+    {
+        if (!fgets(setting, sizeof(setting), fp))
+            setting[0] = '\0';
+        setting[strcspn(setting, "\n")] = '\0';
+        fclose(fp);
+    }
+    snprintf(str, sizeof(str), "Huge pages requested for shared memory (shmem_enabled: %s)\n",
+             setting[0] ? setting : "unknown");
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* faults in the pages of [start, start + length), returns the bytes covered */
+static size_t prefault_range(void *start, size_t length)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    char *first = (char *)((uintptr_t)start & ~(uintptr_t)(page - 1));
+    char *end = (char *)start + length, *p;
+
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(first, end - first, MADV_POPULATE_WRITE) == 0)
+        return end - first;
+#endif
+    /* older kernels: touch every page, rewriting the byte already there */
+    for (p = first; p < end; p += page)
+    {
+        *(volatile char *)p = *(volatile char *)p;
+    }
+    return end - first;
+}
+
+/* faults in the SharedMemory fields from first up to and including last */
+#define PREFAULT_FIELDS(shm, first, last)                                        \
+    prefault_range(&(shm)->first, offsetof(SharedMemory, last) + sizeof((shm)->last) - \
+                                      offsetof(SharedMemory, first))
+
+/* -F: faults in the regions every step touches (drones, the used rows of the
+   state and pair flag arrays or the keyframes, and the control fields) before
+   the run; the collision matrix stays lazy because only colliding pairs are
+   ever written, and the slab outcomes and trace buffers are only faulted in
+   when -x or -T uses them */
+void prefault_hot_regions(SharedMemory *shm)
+{
+    size_t bytes = 0;
+    char str[100];
+    int t, i, groups;
+
+    if (!shm->options.prefault)
+        return;
+
+    bytes += prefault_range(shm->drones, shm->num_drones * sizeof(Drone));
+    for (i = 0; shm->options.keyframes && i < shm->num_drones; i++)
+    {
+        bytes += prefault_range(shm->keyframes[i], shm->keyframe_count[i] * sizeof(Keyframe));
+    }
+    for (t = 0; !shm->options.keyframes && t < shm->time_steps; t++)
+    {
+        if (shm->options.quantised_states)
+            bytes += prefault_range(shm->quantised_states[t], shm->num_drones * sizeof(QuantisedState));
+        else
+            bytes += prefault_range(shm->time_indexed_states[t],
+                                    shm->num_drones * sizeof(TimeIndexedDroneState));
+    }
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        bytes += prefault_range(shm->collision_detected_this_timestep[i], shm->num_drones * sizeof(int));
+    }
+
+    bytes += PREFAULT_FIELDS(shm, options, report_ready);
+    bytes += PREFAULT_FIELDS(shm, matrix_generation, pair_flag_generation);
+    if (shm->options.slabs > 1)
+    {
+        bytes += prefault_range(shm->slab_outcome, shm->time_steps * sizeof(shm->slab_outcome[0]));
+        bytes += PREFAULT_FIELDS(shm, slab_pairs, slab_ghosts);
+    }
+    bytes += PREFAULT_FIELDS(shm, detection_requested_step, jitter_histogram);
+    if (shm->options.trace_path[0])
+    {
+        /* coordinator, detection and report buffers plus one per drone group */
+        groups = (shm->num_drones + shm->options.group_size - 1) / shm->options.group_size;
+        bytes += prefault_range(shm->trace, (TRACE_DRONES + groups) * sizeof(shm->trace[0]));
+    }
+    bytes += PREFAULT_FIELDS(shm, trace_count, pool_shutdown);
+
+    snprintf(str, sizeof(str), "Prefaulted %zu KiB of hot shared memory\n", bytes / 1024);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* O_EXCL semaphore creation; the caller owns the namespace's shared memory,
+   so a semaphore that already exists can only be left over from a crash */
+sem_t *create_semaphore(const char *name)
+{
+    sem_t *sem = sem_open(name, O_CREAT | O_EXCL, 0644, 0);
+
+    if (sem == SEM_FAILED && errno == EEXIST)
+    {
+        sem_unlink(name);
+        sem = sem_open(name, O_CREAT | O_EXCL, 0644, 0);
+    }
+    return sem;
+}
@@ -0,0 +1,211 @@
+#include "../includes/simulation.h"
+
+/* keyframe trajectories (-k[tolerance]): each drone keeps only the samples
+   where its motion changes. The loaders stage the samples outside shared
+   memory and hand them over here, so neither the sampled trajectory nor the
+   per-step states are written; the drones, the pre-calculation and detection
+   evaluate every position on demand and culling bounds whole linear segments
+   at once */
+
+/* last segment used per drone, positions are mostly asked for in time order;
+   per thread, since the detection thread and the parallel passes evaluate
+   the same drones concurrently */
+static __thread int cursor[MAX_DRONES];
+
+/* largest interpolation error per drone, for the summary */
+static float keyframe_error[MAX_DRONES];
+
+/* the one interpolation used for compression and evaluation, so a tolerance
+   of 0 reproduces every sample bit for bit */
+static Position lerp_keyframes(const Keyframe *a, const Keyframe *b, int timestep)
+{
+    float f = (float)(timestep - a->timestep) / (b->timestep - a->timestep);
+    Position pos;
+
+    pos.x = a->pos.x + (b->pos.x - a->pos.x) * f;
+    pos.y = a->pos.y + (b->pos.y - a->pos.y) * f;
+    pos.z = a->pos.z + (b->pos.z - a->pos.z) * f;
+    return pos;
+}
+
+static float sample_error(Position a, Position b)
+{
+    return fmaxf(fabsf(a.x - b.x), fmaxf(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+/* whether the segment from keyframe a to sample e reproduces the samples in
+   between within the tolerance */
+static int segment_fits(SharedMemory *shm, const Position *samples, const Keyframe *a, int e)
+{
+    Keyframe b;
+    int t;
+
+    b.timestep = e;
+    b.pos = samples[e];
+    for (t = a->timestep + 1; t < e; t++)
+    {
+        if (sample_error(lerp_keyframes(a, &b, t), samples[t]) > shm->options.keyframe_tolerance)
+            return 0;
+    }
+    return 1;
+}
+
+static void add_keyframe(SharedMemory *shm, int drone_id, const Position *samples, int timestep)
+{
+    Keyframe *k = &shm->keyframes[drone_id][shm->keyframe_count[drone_id]++];
+
+    k->timestep = timestep;
+    k->pos = samples[timestep];
+}
+
+static void compress_trajectory(SharedMemory *shm, int drone_id, const Position *samples)
+{
+    int s = 0, e, last = shm->time_steps - 1;
+
+    shm->keyframe_count[drone_id] = 0;
+    cursor[drone_id] = 0;
+    add_keyframe(shm, drone_id, samples, 0);
+
+    while (s < last)
+    {
+        if (!is_valid_position(samples[s]))
+        {
+            /* an invalid run ends at the next valid sample */
+            for (e = s + 1; e <= last && !is_valid_position(samples[e]); e++)
+                ;
+            if (e > last)
+                break;
+        }
+        else if (!is_valid_position(samples[s + 1]))
+        {
+            e = s + 1;
+        }
+        else
+        {
+            /* the longest valid segment the interpolation reproduces */
+            Keyframe *start = &shm->keyframes[drone_id][shm->keyframe_count[drone_id] - 1];
+            for (e = s + 1; e < last && is_valid_position(samples[e + 1]) &&
+                            segment_fits(shm, samples, start, e + 1);
+                 e++)
+                ;
+        }
+        add_keyframe(shm, drone_id, samples, e);
+        s = e;
+    }
+}
+
+/* keyframe evaluation, returns 0 for samples in an invalid run */
+static int keyframe_at(SharedMemory *shm, int drone_id, int timestep, Position *pos)
+{
+    const Keyframe *k = shm->keyframes[drone_id];
+    int n = shm->keyframe_count[drone_id], c = cursor[drone_id];
+
+    if (c >= n || k[c].timestep > timestep)
+        c = 0;
+    while (c + 1 < n && k[c + 1].timestep <= timestep)
+        c++;
+    cursor[drone_id] = c;
+
+    if (!is_valid_position(k[c].pos))
+    {
+        pos->x = pos->y = pos->z = 0.0f;
+        return 0;
+    }
+    if (k[c].timestep == timestep || c + 1 >= n)
+        *pos = k[c].pos;
+    else
+        *pos = lerp_keyframes(&k[c], &k[c + 1], timestep);
+    return 1;
+}
+
+/* position of drone_id at timestep from its keyframes, or from the sampled
+   trajectory when keyframes are off */
+Position trajectory_position(SharedMemory *shm, int drone_id, int timestep)
+{
+    Position pos;
+
+    if (!shm->options.keyframes)
+        return shm->drones[drone_id].trajectory[timestep];
+
+    keyframe_at(shm, drone_id, timestep, &pos);
+    return pos;
+}
+
+static void grow_point(DroneAABB *box, Position p)
+{
+    box->minX = fminf(box->minX, p.x);
+    box->maxX = fmaxf(box->maxX, p.x);
+    box->minY = fminf(box->minY, p.y);
+    box->maxY = fmaxf(box->maxY, p.y);
+    box->minZ = fminf(box->minZ, p.z);
+    box->maxZ = fmaxf(box->maxZ, p.z);
+}
+
+/* bounds of the centre positions from first to last: a linear segment lies
+   within the box of its end points, so only the window ends and the keyframes
+   inside are visited; returns 0 when no sample in the window is valid */
+int keyframe_window_box(SharedMemory *shm, int drone_id, int first, int last, DroneAABB *box)
+{
+    const Keyframe *k = shm->keyframes[drone_id];
+    int c, n = shm->keyframe_count[drone_id], found = 0;
+    Position pos;
+
+    box->minX = box->minY = box->minZ = INFINITY;
+    box->maxX = box->maxY = box->maxZ = -INFINITY;
+
+    if (keyframe_at(shm, drone_id, first, &pos))
+    {
+        grow_point(box, pos);
+        found = 1;
+    }
+    for (c = cursor[drone_id] + 1; c < n && k[c].timestep < last; c++)
+    {
+        if (!is_valid_position(k[c].pos))
+            continue;
+        grow_point(box, k[c].pos);
+        found = 1;
+    }
+    if (keyframe_at(shm, drone_id, last, &pos))
+    {
+        grow_point(box, pos);
+        found = 1;
+    }
+    return found;
+}
+
+/* compresses the staged samples of drone_id into its keyframes */
+void store_keyframes(SharedMemory *shm, int drone_id, const Position *samples)
+{
+    int t;
+
+    compress_trajectory(shm, drone_id, samples);
+    keyframe_error[drone_id] = 0.0f;
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        keyframe_error[drone_id] = fmaxf(keyframe_error[drone_id],
+                                         sample_error(trajectory_position(shm, drone_id, t), samples[t]));
+    }
+}
+
+void report_keyframes(SharedMemory *shm)
+{
+    int i, kept = 0;
+    float max_error = 0.0f;
+    char str[300];
+
+    if (!shm->options.keyframes)
+        return;
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        kept += shm->keyframe_count[i];
+        max_error = fmaxf(max_error, keyframe_error[i]);
+    }
+
+    /* against the sampled trajectory plus the float states it replaces */
+    snprintf(str, sizeof(str), "Keyframes: %d of %d samples kept (%.1f%%, %zu of %zu bytes), max error %.3f\n",
+             kept, shm->num_drones * shm->time_steps,
+             100.0 * kept / (shm->num_drones * shm->time_steps), kept * sizeof(Keyframe),
+             shm->num_drones * shm->time_steps * (sizeof(Position) + sizeof(TimeIndexedDroneState)), max_error);
+    write(STDOUT_FILENO, str, strlen(str));
+}
@@ -1,9 +1,13 @@
 #include "../includes/simulation.h"
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/file.h>
 
 int fd_shm;
 SharedMemory *shm;
 sem_t *sem_step_ready;
 sem_t *sem_step_continue;
+sem_t *sem_step_continue_odd;
 pthread_t collision_thread;
 pthread_t report_thread;
 pthread_mutex_t step_mutex;
@@ -11,6 +15,10 @@ pthread_cond_t step_cond;
 pthread_mutex_t collision_mutex;
 pthread_cond_t collision_cond;
 
+/* start of the current run, for time-to-first-step and its page faults */
+static double startup_time;
+static long startup_faults;
+
 void signal_handler(int sig)
 {
     char msg[100];
@@ -31,9 +39,12 @@ void signal_handler(int sig)
         pthread_mutex_unlock(&step_mutex);
 
         /* wake up drone processes */
-        for (int i = 0; i < shm->num_drones; i++)
+        for (int i = 0; i < drone_group_count(shm); i++)
         {
             sem_post(sem_step_continue);
+            sem_post(sem_step_continue_odd);
+            if (shm->options.change_driven)
+                sem_post(&shm->group_wake[i]);
         }
     }
 
@@ -41,10 +52,175 @@ void signal_handler(int sig)
     exit(0);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     pid_t drone_pids[MAX_DRONES];
-    int i, data_size;
+    int i, first, opt, pool_mode = 0;
+    char *pool_command = NULL;
+    char run_id[32];
+    SimulationOptions options;
+
+    mark_startup();
+    memset(&options, 0, sizeof(options));
+    snprintf(options.data_dir, sizeof(options.data_dir), "%s", DEFAULT_DATA_DIR);
+    options.pool_size = MAX_DRONES;
+    snprintf(options.report_path, sizeof(options.report_path), "%s", DEFAULT_REPORT_PATH);
+    options.substeps = DEFAULT_SUBSTEPS;
+    options.group_size = 1;
+    set_ipc_namespace("");
+    while ((opt = getopt(argc, argv, "qd:Pw:C:a:em:s:L::r:o:f:c::S:g:pt:HFx:k::M:DT:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'q':
+            options.quantised_states = 1;
+            break;
+        case 'd':
+            snprintf(options.data_dir, sizeof(options.data_dir), "%s", optarg);
+            break;
+        case 'P':
+            pool_mode = 1;
+            break;
+        case 'w':
+            options.pool_size = atoi(optarg);
+            break;
+        case 'C':
+            pool_command = optarg;
+            break;
+        case 'e':
+            options.count_episodes = 1;
+            break;
+        case 'm':
+            options.substep_margin = atof(optarg);
+            break;
+        case 's':
+            options.substeps = atoi(optarg);
+            if (options.substeps < 2)
+                options.substeps = 2;
+            if (options.substeps > MAX_SUBSTEPS)
+                options.substeps = MAX_SUBSTEPS;
+            break;
+        case 'L':
+            snprintf(options.event_log_path, sizeof(options.event_log_path), "%s",
+                     optarg ? optarg : DEFAULT_EVENT_LOG);
+            break;
+        case 'r':
+            if (strcmp(optarg, "pid") == 0)
+            {
+                snprintf(run_id, sizeof(run_id), "%d", getpid());
+                set_ipc_namespace(run_id);
+            }
+            else
+            {
+                set_ipc_namespace(optarg);
+            }
+            break;
+        case 'o':
+            snprintf(options.report_path, sizeof(options.report_path), "%s", optarg);
+            break;
+        case 'f':
+            snprintf(options.figure_path, sizeof(options.figure_path), "%s", optarg);
+            break;
+        case 'c':
+            options.use_cache = 1;
+            if (optarg)
+                snprintf(options.cache_path, sizeof(options.cache_path), "%s", optarg);
+            break;
+        case 'g':
+            options.group_size = atoi(optarg);
+            if (options.group_size < 1)
+                options.group_size = 1;
+            break;
+        case 'p':
+            options.pipeline = 1;
+            break;
+        case 'k':
+            options.keyframes = 1;
+            options.keyframe_tolerance = optarg ? atof(optarg) : 0.0f;
+            break;
+        case 'T':
+            snprintf(options.trace_path, sizeof(options.trace_path), "%s", optarg);
+            break;
+        case 'D':
+            options.change_driven = 1;
+            break;
+        case 'M':
+            options.near_miss_factor = atof(optarg);
+            break;
+        case 'x':
+            options.slabs = atoi(optarg);
+            if (options.slabs > MAX_SLABS)
+                options.slabs = MAX_SLABS;
+            break;
+        case 'H':
+            options.huge_pages = 1;
+            break;
+        case 'F':
+            options.prefault = 1;
+            break;
+        case 't':
+            options.step_period = atof(optarg) / 1000.0;
+            if (options.step_period < 0.0)
+                options.step_period = 0.0;
+            break;
+        case 'S':
+            snprintf(options.solve_dir, sizeof(options.solve_dir), "%s", optarg);
+            break;
+        case 'a':
+            if ((options.affinity_policy = parse_affinity_policy(optarg)) >= 0)
+                break;
+            /* fall through */
+        default:
+            fprintf(stderr, "Usage: %s [-q] [-d data_dir] [-P [-w workers]] [-C run|shutdown] [-a policy] [-e]\n"
+                            "       [-m margin [-s substeps]] [-L[file]] [-r run_id|pid] [-o report]\n"
+                            "       [-f figure] [-c[file]] [-S out_dir] [-g group_size] [-p]\n"
+                            "       [-t period_ms] [-H] [-F] [-x slabs] [-k[tolerance]]\n"
+                            "       [-M near_miss_factor] [-D] [-T trace.json]\n", argv[0]);
+            fprintf(stderr, "  -q  store states as quantised int16 coordinates (trajectories stay float)\n");
+            fprintf(stderr, "  -d  directory holding info.csv and the drone movement files\n");
+            fprintf(stderr, "  -P  start a persistent drone worker pool daemon\n");
+            fprintf(stderr, "  -w  number of pooled drone workers (default %d)\n", MAX_DRONES);
+            fprintf(stderr, "  -C  send a command to a running pool daemon\n");
+            fprintf(stderr, "  -a  CPU placement policy: none, pinned or topology\n");
+            fprintf(stderr, "  -e  count collision episodes instead of samples toward the threshold\n");
+            fprintf(stderr, "  -m  refine pairs closer than margin units between timesteps\n");
+            fprintf(stderr, "  -s  sub-steps per refined interval (default %d)\n", DEFAULT_SUBSTEPS);
+            fprintf(stderr, "  -r  namespace the IPC objects of this run (pid uses the process ID)\n");
+            fprintf(stderr, "  -o  report file (default %s)\n", DEFAULT_REPORT_PATH);
+            fprintf(stderr, "  -f  evaluate drone patterns from a figure file instead of movement files\n");
+            fprintf(stderr, "  -c  reuse pair results of unchanged drones from a cache (default data_dir/collision_cache.bin)\n");
+            fprintf(stderr, "  -S  search start delays and altitude offsets that remove collisions, write them to out_dir\n");
+            fprintf(stderr, "  -g  drones flown by each drone process (default 1)\n");
+            fprintf(stderr, "  -p  pipeline collision processing with drone stepping (lag %d step)\n", PIPELINE_LAG);
+            fprintf(stderr, "  -t  paced mode: release one timestep every period_ms of wall-clock time\n");
+            fprintf(stderr, "  -H  back the shared memory with transparent huge pages where the kernel allows it\n");
+            fprintf(stderr, "  -F  prefault the shared memory regions touched every step before the run\n");
+            fprintf(stderr, "  -T  record the coordination handshake as a Chrome trace (see ./trace_analyser)\n");
+            fprintf(stderr, "  -D  change-driven stepping, only groups with a moving or finishing drone are woken\n");
+            fprintf(stderr, "  -M  write density_map.csv next to the report, near misses under factor * drone size\n");
+            fprintf(stderr, "  -k  keep only trajectory keyframes, interpolated within tolerance (default 0, exact)\n");
+            fprintf(stderr, "  -x  split the collision pre-calculation over slab worker processes (max %d)\n", MAX_SLABS);
+            fprintf(stderr, "  -L  append step summaries and collisions to a binary log (default %s)\n", DEFAULT_EVENT_LOG);
+            exit(15);
+        }
+    }
+
+    if (options.use_cache && options.cache_path[0] == '\0')
+    {
+        snprintf(options.cache_path, sizeof(options.cache_path), CACHE_PATH_FORMAT, options.data_dir);
+    }
+
+    /* keyframes replace the stored states, so there are none to quantise */
+    if (options.keyframes && options.quantised_states)
+    {
+        fprintf(stderr, "Warning: -q has no effect with -k, keyframe positions are evaluated in float\n");
+        options.quantised_states = 0;
+    }
+
+    if (pool_command)
+    {
+        return pool_client(pool_command, &options);
+    }
 
     if (signal(SIGINT, signal_handler) == SIG_ERR)
     {
@@ -57,19 +233,107 @@ int main()
         exit(2);
     }
 
+    if (pool_mode)
+    {
+        pool_daemon(&options);
+        return 0;
+    }
+
     char str[100];
     snprintf(str, sizeof(str), "Loading configuration from CSV files...\n");
     write(STDOUT_FILENO, str, strlen(str));
 
     /* US361: create shared memory */
-    data_size = sizeof(SharedMemory);
-    if ((fd_shm = shm_open("/drone_sim", O_CREAT | O_EXCL | O_RDWR,
-                           S_IRUSR | S_IWUSR)) == -1)
+    create_shared_memory();
+
+    shm->options = options;
+    prepare_simulation(shm);
+
+    create_synchronisation();
+
+    /* solver mode works on the pre-calculated states only, no drone is started */
+    if (options.solve_dir[0] != '\0')
+    {
+        solve_deconfliction(shm);
+        cleanup_resources();
+        return 0;
+    }
+
+    shm->options.affinity_policy = plan_cpu_placement(options.affinity_policy);
+    apply_placement(pthread_self(), PLACEMENT_COORDINATOR, 0);
+    start_threads();
+
+    /* Create drone processes, one per group of consecutive drone IDs */
+    for (i = 0; i < drone_group_count(shm); i++)
+    {
+        first = i * shm->options.group_size;
+        drone_pids[i] = fork();
+        if (drone_pids[i] == 0)
+        {
+            apply_placement(pthread_self(), PLACEMENT_DRONE, i);
+            drone_process(first, first + shm->options.group_size < shm->num_drones
+                                     ? shm->options.group_size
+                                     : shm->num_drones - first);
+            exit(0);
+        }
+        else if (drone_pids[i] < 0)
+        {
+            perror("fork");
+            exit(14);
+        }
+    }
+
+    snprintf(str, sizeof(str), "All %d drones launched in %d processes. Starting simulation...\n",
+             shm->num_drones, drone_group_count(shm));
+    write(STDOUT_FILENO, str, strlen(str));
+
+    run_timesteps(shm);
+    stop_simulation(shm);
+
+    /* wait for all drone processes */
+    for (i = 0; i < drone_group_count(shm); i++)
+    {
+        wait(NULL);
+    }
+
+    /* wait for threads to finish */
+    join_threads();
+    write_trace(shm);
+
+    print_simulation_status(shm);
+    snprintf(str, sizeof(str), "All processes terminated. Cleaning up...\n");
+    write(STDOUT_FILENO, str, strlen(str));
+    cleanup_resources();
+    snprintf(str, sizeof(str), "Simulation completed successfully.\n");
+    write(STDOUT_FILENO, str, strlen(str));
+    return 0;
+}
+
+void create_shared_memory(void)
+{
+    int data_size = sizeof(SharedMemory);
+    int fd_lock;
+
+    /* serialises creation and stale recovery of the namespace, so a starter
+       never sees a live segment whose owner has not been published yet; the
+       lock file itself is left in place, removing it would race a waiter */
+    if ((fd_lock = open(ipc_names.create_lock, O_CREAT | O_RDWR, 0644)) == -1 ||
+        flock(fd_lock, LOCK_EX) == -1)
     {
-        perror("shm_open");
+        perror("create lock");
         exit(3);
     }
 
+    while ((fd_shm = shm_open(ipc_names.shm, O_CREAT | O_EXCL | O_RDWR,
+                              S_IRUSR | S_IWUSR)) == -1)
+    {
+        if (errno != EEXIST || !recover_stale_ipc())
+        {
+            perror("shm_open");
+            exit(3);
+        }
+    }
+
     if (ftruncate(fd_shm, data_size) == -1)
     {
         perror("ftruncate");
@@ -82,8 +346,20 @@ int main()
         perror("mmap");
         exit(5);
     }
+    shm->owner_pid = getpid();
+
+    flock(fd_lock, LOCK_UN);
+    close(fd_lock);
+}
+
+/* loads the scenario from shm->options.data_dir and pre-calculates it */
+void prepare_simulation(SharedMemory *shm)
+{
+    char str[100];
 
+    advise_shared_memory(shm);
     initialise_simulation(shm);
+    prefault_hot_regions(shm);
 
     snprintf(str, sizeof(str), "Simulation configured:\n");
     write(STDOUT_FILENO, str, strlen(str));
@@ -102,24 +378,38 @@ int main()
 
     snprintf(str, sizeof(str), "Pre-calculating all drone positions and collision matrix...\n");
     write(STDOUT_FILENO, str, strlen(str));
-    pre_calculate_positions(shm);
+    if (!shm->pre_calculation_complete)
+    {
+        pre_calculate_positions(shm);
+    }
     collision_detection(shm);
+    build_density_map(shm);
+    reset_trace(shm);
     snprintf(str, sizeof(str), "Pre-calculation complete. Collision matrix ready.\n");
     write(STDOUT_FILENO, str, strlen(str));
+}
 
+void create_synchronisation(void)
+{
     /* create semaphores */
-    if ((sem_step_ready = sem_open("/sem_step_ready", O_CREAT | O_EXCL, 0644, 0)) == SEM_FAILED)
+    if ((sem_step_ready = create_semaphore(ipc_names.sem_step_ready)) == SEM_FAILED)
     {
         perror("sem_open step_ready");
         exit(6);
     }
 
-    if ((sem_step_continue = sem_open("/sem_step_continue", O_CREAT | O_EXCL, 0644, 0)) == SEM_FAILED)
+    if ((sem_step_continue = create_semaphore(ipc_names.sem_step_continue)) == SEM_FAILED)
     {
         perror("sem_open step_continue");
         exit(7);
     }
 
+    if ((sem_step_continue_odd = create_semaphore(ipc_names.sem_step_continue_odd)) == SEM_FAILED)
+    {
+        perror("sem_open step_continue_odd");
+        exit(21);
+    }
+
     /* mutexes and condition variables */
     if (pthread_mutex_init(&step_mutex, NULL) != 0)
     {
@@ -144,7 +434,10 @@ int main()
         perror("pthread_cond_init collision");
         exit(11);
     }
+}
 
+void start_threads(void)
+{
     if (pthread_create(&collision_thread, NULL, collision_detection_thread, shm) != 0)
     {
         perror("pthread_create collision");
@@ -157,54 +450,193 @@ int main()
         exit(13);
     }
 
-    /* Create drone processes */
-    for (i = 0; i < shm->num_drones; i++)
+    apply_placement(collision_thread, PLACEMENT_DETECTION, 0);
+    apply_placement(report_thread, PLACEMENT_REPORT, 0);
+}
+
+void join_threads(void)
+{
+    pthread_join(collision_thread, NULL);
+    pthread_join(report_thread, NULL);
+}
+
+/* logs and prints every step summary the detection thread has finished,
+   returns the last step reported */
+static int report_completed_steps(SharedMemory *shm, int reported, int written)
+{
+    PipelineSlot *slot;
+    char str[100];
+
+    while (reported < written && reported < shm->detection_completed_step)
     {
-        drone_pids[i] = fork();
-        if (drone_pids[i] == 0)
-        {
-            drone_process(i);
-            exit(0);
-        }
-        else if (drone_pids[i] < 0)
-        {
-            perror("fork");
-            exit(14);
-        }
+        slot = &shm->pipeline[++reported % PIPELINE_SLOTS];
+
+        /* steps a pipelined run moved past the exceeding step are not counted */
+        if (shm->threshold_timestep >= 0 && slot->timestep > shm->threshold_timestep)
+            continue;
+        log_step_summary(slot);
+
+        snprintf(str, sizeof(str), "Timestep %d/%d (Active drones: %d, Collisions: %d)\n",
+                 slot->timestep, shm->time_steps, slot->active_drones, slot->collision_count);
+        write(STDOUT_FILENO, str, strlen(str));
     }
+    return reported;
+}
+
+/* seqlock writer for the monitor, never waits for a reader */
+static void publish_monitor_snapshot(SharedMemory *shm, double latency, int finished)
+{
+    shm->monitor_sequence++;
+    __sync_synchronize();
+    shm->monitor.timestep = shm->current_timestep;
+    shm->monitor.time_steps = shm->time_steps;
+    shm->monitor.active_drones = shm->active_drone_count;
+    shm->monitor.collision_count = shm->collision_count;
+    shm->monitor.max_collisions = shm->max_collisions;
+    shm->monitor.finished = finished;
+    shm->monitor.latency = latency;
+    shm->monitor.elapsed = get_current_time() - shm->simulation_start_time;
+    __sync_synchronize();
+    shm->monitor_sequence++;
+}
 
-    snprintf(str, sizeof(str), "All %d drones launched. Starting simulation...\n", shm->num_drones);
+/* blocks until the detection thread has processed step */
+static void wait_for_detection(SharedMemory *shm, int step)
+{
+    pthread_mutex_lock(&step_mutex);
+    while (shm->detection_completed_step < step && !shm->simulation_finished)
+    {
+        pthread_cond_wait(&step_cond, &step_mutex);
+    }
+    pthread_mutex_unlock(&step_mutex);
+}
+
+static int threshold_exceeded(SharedMemory *shm)
+{
+    char str[150];
+
+    if (shm->threshold_timestep < 0)
+        return 0;
+
+    snprintf(str, sizeof(str), "SIMULATION TERMINATED: Collision threshold exceeded (%d >= %d)\n",
+             shm->collision_count, shm->max_collisions);
+    write(STDOUT_FILENO, str, strlen(str));
+    shm->simulation_finished = 1;
+    return 1;
+}
+
+void mark_startup(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    startup_time = get_current_time();
+    startup_faults = usage.ru_minflt;
+}
+
+/* coordinator time and minor page faults from mark_startup() to the release
+   of the first timestep */
+static void record_first_step(SharedMemory *shm)
+{
+    struct rusage usage;
+    char str[150];
+
+    getrusage(RUSAGE_SELF, &usage);
+    shm->startup_latency = get_current_time() - startup_time;
+    shm->startup_faults = usage.ru_minflt - startup_faults;
+    snprintf(str, sizeof(str), "Startup: first step released after %.2f ms, %ld minor page faults\n",
+             shm->startup_latency * 1e3, shm->startup_faults);
     write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* paced mode: sleeps until the absolute deadline of the next step release
+   and records how late the release is; deadlines stay on the start + k * period
+   grid, so a miss does not shift the following steps; returns the seconds slept */
+static double pace_step(SharedMemory *shm, struct timespec *deadline)
+{
+    struct timespec now;
+    double arrival, lateness, slept = 0.0;
+    long nsec = deadline->tv_nsec + (long)(shm->options.step_period * 1e9);
+    int bucket, late_us;
+
+    deadline->tv_sec += nsec / 1000000000L;
+    deadline->tv_nsec = nsec % 1000000000L;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    arrival = now.tv_sec + now.tv_nsec / 1e9;
+    if (now.tv_sec > deadline->tv_sec ||
+        (now.tv_sec == deadline->tv_sec && now.tv_nsec > deadline->tv_nsec))
+    {
+        shm->deadline_misses++;
+    }
+    else
+    {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR &&
+               !shm->simulation_finished)
+            ;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        slept = now.tv_sec + now.tv_nsec / 1e9 - arrival;
+    }
+
+    lateness = (now.tv_sec - deadline->tv_sec) + (now.tv_nsec - deadline->tv_nsec) / 1e9;
+    if (lateness < 0.0)
+        lateness = 0.0;
+    if (shm->paced_steps < MAX_TIMESTEPS)
+    {
+        shm->step_lateness[shm->paced_steps++] = lateness;
+    }
+
+    late_us = lateness * 1e6 > INT32_MAX ? INT32_MAX : (int)(lateness * 1e6);
+    for (bucket = 0; late_us > 0 && bucket < JITTER_BUCKETS - 1; bucket++)
+    {
+        late_us >>= 1;
+    }
+    shm->jitter_histogram[bucket]++;
+    return slept;
+}
+
+/* US364: lockstep coordination of the drones, one iteration per timestep */
+void run_timesteps(SharedMemory *shm)
+{
+    int i, executed, release, reported = 0;
+    int lag = shm->options.pipeline ? PIPELINE_LAG : 0;
+    char str[100];
+    double step_start, slept;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    shm->simulation_start_time = deadline.tv_sec + deadline.tv_nsec / 1e9;
+    open_event_log(shm);
+    publish_monitor_snapshot(shm, 0.0, 0);
 
     /* US364 */
     while (shm->current_timestep < shm->time_steps && !shm->simulation_finished)
     {
-        /* wait for all active drones to be ready */
-        int active_drones = 0;
-        for (i = 0; i < shm->num_drones; i++)
-        {
-            if (shm->drones[i].active)
-            {
-                active_drones++;
-            }
-        }
+        step_start = get_current_time();
+        trace_event(shm, TRACE_COORDINATOR, TRACE_STEP_BEGIN, shm->current_timestep);
+
+        /* wait for all groups with an active drone to be ready; in
+           change-driven stepping only the woken groups arrive */
+        int active_groups = shm->options.change_driven ? posting_groups(shm->current_timestep)
+                                                       : count_active_groups(shm);
 
         /* bounds checking */
-        if (active_drones < 0 || active_drones > MAX_DRONES)
+        if (active_groups < 0 || active_groups > MAX_DRONES)
         {
-            snprintf(str, sizeof(str), "Warning: Invalid active drone count %d\n", active_drones);
+            snprintf(str, sizeof(str), "Warning: Invalid active group count %d\n", active_groups);
             write(STDOUT_FILENO, str, strlen(str));
             break;
         }
 
-        /* block until a drone signals ready */
-        for (i = 0; i < active_drones; i++)
+        /* block until a group signals ready */
+        for (i = 0; i < active_groups; i++)
         {
             sem_wait(sem_step_ready);
         }
+        trace_event(shm, TRACE_COORDINATOR, TRACE_BARRIER_DONE, shm->current_timestep);
 
         /* alll drones ready  */
-        shm->current_timestep++;
+        executed = shm->current_timestep++;
 
         /* bounds checking for timestep */
         if (shm->current_timestep >= MAX_TIMESTEPS)
@@ -214,65 +646,85 @@ int main()
             break;
         }
 
-        /* signal collision detection thread */
+        /* hand the step to the collision detection thread */
         pthread_mutex_lock(&step_mutex);
-        shm->timestep_ready_for_collision = 1;
-        pthread_cond_signal(&step_cond);
+        shm->detection_requested_step = shm->current_timestep;
+        pthread_cond_broadcast(&step_cond);
         pthread_mutex_unlock(&step_mutex);
 
-        /* wait for collision detection to complete */
-        pthread_mutex_lock(&step_mutex);
-        while (!shm->collision_detection_complete && !shm->simulation_finished)
-        {
-            pthread_cond_wait(&step_cond, &step_mutex);
-        }
-        shm->collision_detection_complete = 0;
-        shm->timestep_ready_for_collision = 0;
-        pthread_mutex_unlock(&step_mutex);
+        /* serially wait for it to complete, pipelined only for the steps
+           more than PIPELINE_LAG behind so detection overlaps the next move */
+        trace_event(shm, TRACE_COORDINATOR, TRACE_DETECT_WAIT, executed);
+        wait_for_detection(shm, shm->current_timestep - lag);
 
-        /* signal all drones to continue */
-        for (i = 0; i < active_drones; i++)
-        {
-            sem_post(sem_step_continue); /* unblock waiting drones */
-        }
+        /* no drone moves past a step whose detection crossed the threshold */
+        release = shm->threshold_timestep < 0;
 
-        /* clear collision tracking matrix AFTER drones have moved !! */
-        for (int x = 0; x < MAX_DRONES; x++)
+        /* in paced mode the drones are released on the step's deadline */
+        slept = release && shm->options.step_period > 0.0 ? pace_step(shm, &deadline) : 0.0;
+
+        /* signal all groups to continue */
+        if (release)
         {
-            for (int y = 0; y < MAX_DRONES; y++)
+            trace_event(shm, TRACE_COORDINATOR, TRACE_RELEASE, executed);
+            if (shm->options.change_driven)
+            {
+                wake_groups(shm, shm->current_timestep);
+            }
+            else
             {
-                shm->collision_detected_this_timestep[x][y] = 0;
+                for (i = 0; i < active_groups; i++)
+                {
+                    sem_post(step_continue_semaphore(executed)); /* unblock waiting drones */
+                }
             }
         }
+        if (executed == 0)
+            record_first_step(shm);
 
         /* update active drone count */
-        shm->active_drone_count = 0;
-        for (i = 0; i < shm->num_drones; i++)
+        if (shm->options.change_driven)
         {
-            if (shm->drones[i].active)
+            shm->active_drone_count = flying_drones(shm->current_timestep);
+        }
+        else
+        {
+            shm->active_drone_count = 0;
+            for (i = 0; i < shm->num_drones; i++)
             {
-                shm->active_drone_count++;
+                if (shm->drones[i].active)
+                {
+                    shm->active_drone_count++;
+                }
             }
         }
 
-        snprintf(str, sizeof(str), "Timestep %d/%d (Active drones: %d, Collisions: %d)\n",
-                 shm->current_timestep, shm->time_steps,
-                 shm->active_drone_count, shm->collision_count);
-        write(STDOUT_FILENO, str, strlen(str));
-
-        /* check if collision threshold exceeded */
-        if (shm->collision_count >= shm->max_collisions)
+        PipelineSlot *slot = &shm->pipeline[shm->current_timestep % PIPELINE_SLOTS];
+        slot->timestep = shm->current_timestep;
+        slot->active_drones = shm->active_drone_count;
+        slot->latency = get_current_time() - step_start - slept;
+        /* steps past the one that crossed the threshold are not measured */
+        if (shm->step_latency_count < MAX_TIMESTEPS &&
+            (shm->threshold_timestep < 0 || shm->current_timestep <= shm->threshold_timestep))
         {
-            snprintf(str, sizeof(str), "SIMULATION TERMINATED: Collision threshold exceeded (%d >= %d)\n",
-                     shm->collision_count, shm->max_collisions);
-            write(STDOUT_FILENO, str, strlen(str));
-            shm->simulation_finished = 1;
-            break;
+            shm->step_latency[shm->step_latency_count++] = slot->latency;
         }
+        reported = report_completed_steps(shm, reported, shm->current_timestep);
+        publish_monitor_snapshot(shm, slot->latency, 0);
+
+        /* check if collision threshold exceeded, the detection thread stops
+           counting at the step that exceeded it */
+        if (threshold_exceeded(shm))
+            break;
 
         /* check if all drones completed their missions */
         if (shm->active_drone_count == 0)
         {
+            wait_for_detection(shm, shm->current_timestep);
+            reported = report_completed_steps(shm, reported, shm->current_timestep);
+            if (threshold_exceeded(shm))
+                break;
+
             snprintf(str, sizeof(str), "SIMULATION COMPLETED: All drones completed their missions\n");
             write(STDOUT_FILENO, str, strlen(str));
             shm->simulation_finished = 1;
@@ -280,8 +732,25 @@ int main()
         }
     }
 
+    /* steps still in the pipeline */
+    if (!shm->simulation_finished)
+    {
+        wait_for_detection(shm, shm->detection_requested_step);
+        threshold_exceeded(shm);
+    }
+    report_completed_steps(shm, reported, shm->current_timestep);
+    publish_monitor_snapshot(shm, shm->monitor.latency, 1);
+}
+
+/* marks the simulation finished and wakes every waiting thread and drone */
+void stop_simulation(SharedMemory *shm)
+{
+    int i;
+    char str[100];
+
     /* signal simulation end */
     shm->simulation_finished = 1;
+    shm->simulation_end_time = get_current_time();
 
     /* US363: Notify all waiting threads */
     pthread_mutex_lock(&collision_mutex);
@@ -296,28 +765,13 @@ int main()
     write(STDOUT_FILENO, str, strlen(str));
 
     /* wake up any remaining drone processes */
-    for (i = 0; i < shm->num_drones; i++)
+    for (i = 0; i < drone_group_count(shm); i++)
     {
         sem_post(sem_step_continue);
+        sem_post(sem_step_continue_odd);
+        if (shm->options.change_driven)
+            sem_post(&shm->group_wake[i]);
     }
-
-    /* wait for all drone processes */
-    for (i = 0; i < shm->num_drones; i++)
-    {
-        wait(NULL);
-    }
-
-    /* wait for threads to finish */
-    pthread_join(collision_thread, NULL);
-    pthread_join(report_thread, NULL);
-
-    print_simulation_status(shm);
-    snprintf(str, sizeof(str), "All processes terminated. Cleaning up...\n");
-    write(STDOUT_FILENO, str, strlen(str));
-    cleanup_resources();
-    snprintf(str, sizeof(str), "Simulation completed successfully.\n");
-    write(STDOUT_FILENO, str, strlen(str));
-    return 0;
 }
 
 void pre_calculate_positions(SharedMemory *shm)
@@ -325,20 +779,35 @@ void pre_calculate_positions(SharedMemory *shm)
     int drone_id, timestep;
     char str[200];
 
+    if (shm->options.quantised_states)
+    {
+        quantise_positions(shm);
+        return;
+    }
+
+    /* keyframes are evaluated where a position is needed, nothing is stored */
+    if (shm->options.keyframes)
+    {
+        shm->pre_calculation_complete = 1;
+        snprintf(str, sizeof(str), "Positions of %d drones across %d timesteps evaluated on demand from keyframes\n",
+                 shm->num_drones, shm->time_steps);
+        write(STDOUT_FILENO, str, strlen(str));
+        return;
+    }
+
     /* initialize the time indexed matrix */
     for (timestep = 0; timestep < shm->time_steps; timestep++)
     {
         for (drone_id = 0; drone_id < shm->num_drones; drone_id++)
         {
-            if (timestep < shm->time_steps &&
-                is_valid_position(shm->drones[drone_id].trajectory[timestep]))
+            Position pos = trajectory_position(shm, drone_id, timestep);
+
+            if (timestep < shm->time_steps && is_valid_position(pos))
             {
 
-                shm->time_indexed_states[timestep][drone_id].position =
-                    shm->drones[drone_id].trajectory[timestep];
+                shm->time_indexed_states[timestep][drone_id].position = pos;
                 shm->time_indexed_states[timestep][drone_id].bounding_box =
-                    drone_bounding(shm->drones[drone_id].trajectory[timestep],
-                                   shm->drone_size);
+                    drone_bounding(pos, shm->drone_size);
                 shm->time_indexed_states[timestep][drone_id].is_valid = 1;
             }
             else
@@ -354,9 +823,230 @@ void pre_calculate_positions(SharedMemory *shm)
     write(STDOUT_FILENO, str, strlen(str));
 }
 
+/* fills the compact int16 states straight from the trajectories, in the
+   storage the float time_indexed_states would otherwise use */
+void quantise_positions(SharedMemory *shm)
+{
+    int drone_id, timestep;
+    float max_coord = 0.0f;
+    char str[200];
+
+    for (drone_id = 0; drone_id < shm->num_drones; drone_id++)
+    {
+        for (timestep = 0; timestep < shm->time_steps; timestep++)
+        {
+            Position pos = trajectory_position(shm, drone_id, timestep);
+            if (fabsf(pos.x) > max_coord)
+                max_coord = fabsf(pos.x);
+            if (fabsf(pos.y) > max_coord)
+                max_coord = fabsf(pos.y);
+            if (fabsf(pos.z) > max_coord)
+                max_coord = fabsf(pos.z);
+        }
+    }
+
+    /* integer grids that fit in int16 are stored exactly */
+    shm->quantisation_scale = 1.0f;
+    if (max_coord > INT16_MAX)
+    {
+        shm->quantisation_scale = max_coord / INT16_MAX;
+    }
+    /* the box size rounds up so the integer kernel never misses an overlap the
+       float path reports, scaled grids add one unit for the rounding of both
+       centres (the widening swept_interval() allows for) */
+    if (shm->quantisation_scale > 1.0f)
+        shm->quantised_drone_size = (int)floorf(shm->drone_size / shm->quantisation_scale) + 1;
+    else
+        shm->quantised_drone_size = (int)ceilf(shm->drone_size);
+
+    for (timestep = 0; timestep < shm->time_steps; timestep++)
+    {
+        for (drone_id = 0; drone_id < shm->num_drones; drone_id++)
+        {
+            Position pos = trajectory_position(shm, drone_id, timestep);
+            QuantisedState *q = &shm->quantised_states[timestep][drone_id];
+
+            if (is_valid_position(pos))
+            {
+                q->x = (int16_t)lroundf(pos.x / shm->quantisation_scale);
+                q->y = (int16_t)lroundf(pos.y / shm->quantisation_scale);
+                q->z = (int16_t)lroundf(pos.z / shm->quantisation_scale);
+                q->is_valid = 1;
+            }
+            else
+            {
+                q->is_valid = 0;
+            }
+        }
+    }
+
+    shm->pre_calculation_complete = 1;
+    snprintf(str, sizeof(str), "Quantised positions for %d drones across %d timesteps (scale %.4f)\n",
+             shm->num_drones, shm->time_steps, shm->quantisation_scale);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* distance between drone centres, used as the separation of an episode */
+static float centre_separation(Position a, Position b)
+{
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+/* extends the pair's open episode when it collided on the previous timestep,
+   otherwise opens a new one; returns 1 for a new episode */
+static int track_collision_episode(SharedMemory *shm, int open_episode[MAX_DRONES][MAX_DRONES],
+                                   CollisionEvent *collision)
+{
+    int i = collision->drone1_id, j = collision->drone2_id;
+    int id = open_episode[i][j];
+    float separation = centre_separation(collision->pos1, collision->pos2);
+
+    if (id >= 0 && shm->episodes[id].end_timestep == collision->timestep - 1)
+    {
+        CollisionEpisode *episode = &shm->episodes[id];
+        episode->end_timestep = collision->timestep;
+        episode->samples++;
+        if (separation < episode->min_separation)
+            episode->min_separation = separation;
+        shm->collision_matrix[collision->timestep][i][j].episode_id = id;
+        return 0;
+    }
+
+    if (shm->episode_count >= MAX_EPISODES)
+    {
+        shm->collision_matrix[collision->timestep][i][j].episode_id = -1;
+        return 1;
+    }
+
+    id = shm->episode_count++;
+    shm->episodes[id].drone1_id = i;
+    shm->episodes[id].drone2_id = j;
+    shm->episodes[id].start_timestep = collision->timestep;
+    shm->episodes[id].end_timestep = collision->timestep;
+    shm->episodes[id].min_separation = separation;
+    shm->episodes[id].samples = 1;
+    open_episode[i][j] = id;
+    shm->collision_matrix[collision->timestep][i][j].episode_id = id;
+    return 1;
+}
+
+/* gap between two equal drone boxes along the axis where they are furthest
+   apart, zero or less when the boxes overlap */
+static float box_gap(Position a, Position b, int drone_size)
+{
+    float d = fmaxf(fabsf(a.x - b.x), fmaxf(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+    return d - drone_size;
+}
+
+/* adaptive refinement of one pair between timestep and timestep + 1: when the
+   pair comes within substep_margin but neither sample overlaps, the motion is
+   interpolated and checked at finer sub-steps; returns the first colliding
+   sub-step, PAIR_REFINED when none collides and 0 when no refinement is needed */
+static int refine_close_approach(SharedMemory *shm, int timestep, int i, int j)
+{
+    Position a0, a1, b0, b1, pa, pb;
+    float gap0, gap1, f;
+    int k;
+
+    if (timestep + 1 >= shm->time_steps ||
+        !is_state_valid(shm, timestep + 1, i) || !is_state_valid(shm, timestep + 1, j))
+        return 0;
+
+    a0 = state_position(shm, timestep, i);
+    b0 = state_position(shm, timestep, j);
+    a1 = state_position(shm, timestep + 1, i);
+    b1 = state_position(shm, timestep + 1, j);
+    gap0 = box_gap(a0, b0, shm->drone_size);
+    gap1 = box_gap(a1, b1, shm->drone_size);
+
+    /* sampled collisions are already in the matrix */
+    if (gap0 <= 0.0f || gap1 <= 0.0f)
+        return 0;
+    if (fminf(gap0, gap1) >= shm->options.substep_margin)
+        return 0;
+
+    for (k = 1; k < shm->options.substeps; k++)
+    {
+        f = (float)k / shm->options.substeps;
+        pa.x = a0.x + (a1.x - a0.x) * f;
+        pa.y = a0.y + (a1.y - a0.y) * f;
+        pa.z = a0.z + (a1.z - a0.z) * f;
+        pb.x = b0.x + (b1.x - b0.x) * f;
+        pb.y = b0.y + (b1.y - b0.y) * f;
+        pb.z = b0.z + (b1.z - b0.z) * f;
+
+        if (box_gap(pa, pb, shm->drone_size) <= 0.0f)
+            return k;
+    }
+    return PAIR_REFINED;
+}
+
+/* stores the sub-step collision found by refine_close_approach() */
+static void record_substep_collision(SharedMemory *shm, int timestep, int i, int j, int k)
+{
+    Position a0, a1, b0, b1, pa, pb;
+    float f = (float)k / shm->options.substeps;
+    char str[300];
+
+    if (shm->substep_collision_count >= MAX_SUBSTEP_COLLISIONS)
+    {
+        shm->substep_collisions_dropped++;
+        return;
+    }
+
+    a0 = state_position(shm, timestep, i);
+    b0 = state_position(shm, timestep, j);
+    a1 = state_position(shm, timestep + 1, i);
+    b1 = state_position(shm, timestep + 1, j);
+    pa.x = a0.x + (a1.x - a0.x) * f;
+    pa.y = a0.y + (a1.y - a0.y) * f;
+    pa.z = a0.z + (a1.z - a0.z) * f;
+    pb.x = b0.x + (b1.x - b0.x) * f;
+    pb.y = b0.y + (b1.y - b0.y) * f;
+    pb.z = b0.z + (b1.z - b0.z) * f;
+
+    CollisionEvent *collision = &shm->substep_collisions[shm->substep_collision_count++];
+    collision->timestep = timestep;
+    collision->time = timestep + f;
+    collision->drone1_id = i;
+    collision->drone2_id = j;
+    collision->pos1 = pa;
+    collision->pos2 = pb;
+    collision->box1 = drone_bounding(pa, shm->drone_size);
+    collision->box2 = drone_bounding(pb, shm->drone_size);
+
+    snprintf(str, sizeof(str),
+             "SDrones %d and %d at timestep %.3f (sub-step)\n"
+             " Drone %d: pos(%.1f,%.1f,%.1f)\n"
+             " Drone %d: pos(%.1f,%.1f,%.1f)\n",
+             i, j, collision->time, i, pa.x, pa.y, pa.z, j, pb.x, pb.y, pb.z);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* computes the outcome of pair i < j at timestep, encoded as in the collision cache */
+int evaluate_pair(SharedMemory *shm, int timestep, int i, int j)
+{
+    QuantisedState *qrow = shm->quantised_states[timestep];
+    int outcome = 0;
+
+    if (shm->options.substep_margin > 0.0f)
+        outcome = refine_close_approach(shm, timestep, i, j);
+
+    /* perform AABB collision check */
+    if (shm->options.quantised_states
+            ? intersect_quantised(qrow[i], qrow[j], shm->quantised_drone_size)
+            : intersect(state_box(shm, timestep, i), state_box(shm, timestep, j)))
+        outcome |= PAIR_SAMPLED;
+
+    return outcome;
+}
+
 void collision_detection(SharedMemory *shm)
 {
-    int timestep, i, j;
+    int timestep, i, j, p, new_episode, outcome, pair_count, tested, moved, reused = 0;
+    int open_episode[MAX_DRONES][MAX_DRONES];
+    const uint16_t *pairs;
     char str[500];
 
     /* bounds checking */
@@ -373,86 +1063,156 @@ void collision_detection(SharedMemory *shm)
         return;
     }
 
-    /* starting the coollision matrix */
-    for (timestep = 0; timestep < shm->time_steps; timestep++)
+    load_collision_cache(shm);
+    moved = track_motion(shm);
+    tested = cull_pairs(shm);
+    if (shm->options.change_driven)
+        build_changed_pairs(shm);
+
+    /* a new generation invalidates every entry of the previous run */
+    shm->matrix_generation++;
+
+    /* pair evaluation spread over slab workers, merged below in serial order */
+    if (shm->options.slabs > 1)
+        run_slab_workers(shm);
+
+    /* episodes are built incrementally while scanning timesteps in order */
+    shm->episode_count = 0;
+    for (i = 0; i < MAX_DRONES; i++)
     {
-        for (i = 0; i < shm->num_drones; i++)
+        for (j = 0; j < MAX_DRONES; j++)
         {
-            for (j = 0; j < shm->num_drones; j++)
-            {
-                shm->collision_matrix[timestep][i][j].detected = 0;
-                shm->collision_matrix[timestep][i][j].timestep_first_detected = -1;
-            }
+            open_episode[i][j] = -1;
         }
     }
 
+    shm->env_hit_count = 0;
+    shm->env_hits_dropped = 0;
+    shm->substep_collision_count = 0;
+    shm->substep_collisions_dropped = 0;
+    shm->substep_checks = 0;
+
     /* perform collision detection for each timestep */
     for (timestep = 0; timestep < shm->time_steps; timestep++)
     {
-        for (i = 0; i < shm->num_drones - 1; i++)
+        /* drone-vs-environment in the same pass */
+        if (shm->environment_count > 0 || shm->has_ground_limit)
         {
-            if (!shm->time_indexed_states[timestep][i].is_valid)
-                continue;
-
-            for (j = i + 1; j < shm->num_drones; j++)
+            for (i = 0; i < shm->num_drones; i++)
             {
-                if (!shm->time_indexed_states[timestep][j].is_valid)
+                if (!is_state_valid(shm, timestep, i))
                     continue;
+                check_environment(shm, timestep, i, state_position(shm, timestep, i),
+                                  state_box(shm, timestep, i));
+            }
+        }
 
-                /* check if collision already detected for this pair */
-                if (shm->collision_matrix[timestep][i][j].detected)
-                    continue;
+        /* only pairs whose window boxes overlap around this timestep */
+        pairs = candidate_pairs(timestep, &pair_count);
+        for (p = 0; p < pair_count; p++)
+        {
+            i = pairs[p] / MAX_DRONES;
+            j = pairs[p] % MAX_DRONES;
+            if (!is_state_valid(shm, timestep, i) || !is_state_valid(shm, timestep, j))
+                continue;
 
-                /* perform AABB collision check */
-                if (intersect(
-                        shm->time_indexed_states[timestep][i].bounding_box,
-                        shm->time_indexed_states[timestep][j].bounding_box))
+            /* pairs of unchanged drones come from the cache, pairs of drones
+               that hover keep the outcome of the previous timestep */
+            if ((outcome = cached_pair_outcome(timestep, i, j)) < 0)
+            {
+                if (timestep > 0 && static_pair(shm, timestep, i, j))
                 {
-
-                    /* mark collision in matrix */
-                    shm->collision_matrix[timestep][i][j].detected = 1;
-                    shm->collision_matrix[timestep][j][i].detected = 1;
-                    shm->collision_matrix[timestep][i][j].timestep_first_detected = timestep;
-                    shm->collision_matrix[timestep][j][i].timestep_first_detected = timestep;
-
-                    /* store collision event data */
-                    CollisionEvent *collision = &shm->collision_matrix[timestep][i][j].event_data;
-                    collision->timestep = timestep;
-                    collision->drone1_id = i;
-                    collision->drone2_id = j;
-                    collision->pos1 = shm->time_indexed_states[timestep][i].position;
-                    collision->pos2 = shm->time_indexed_states[timestep][j].position;
-                    collision->box1 = shm->time_indexed_states[timestep][i].bounding_box;
-                    collision->box2 = shm->time_indexed_states[timestep][j].bounding_box;
-
-                    snprintf(str, sizeof(str),
-                             "TDrones %d and %d at timestep %d\n"
-                             " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n"
-                             " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n",
-                             i, j, timestep,
-                             i, collision->pos1.x, collision->pos1.y, collision->pos1.z,
-                             collision->box1.minX, collision->box1.maxX,
-                             collision->box1.minY, collision->box1.maxY,
-                             collision->box1.minZ, collision->box1.maxZ,
-                             j, collision->pos2.x, collision->pos2.y, collision->pos2.z,
-                             collision->box2.minX, collision->box2.maxX,
-                             collision->box2.minY, collision->box2.maxY,
-                             collision->box2.minZ, collision->box2.maxZ);
-                    write(STDOUT_FILENO, str, strlen(str));
+                    outcome = current_pair_outcome(timestep - 1, i, j);
+                    reused++;
+                }
+                else
+                {
+                    outcome = shm->options.slabs > 1 ? slab_pair_outcome(shm, timestep, i, j)
+                                                     : evaluate_pair(shm, timestep, i, j);
                 }
+                store_pair_outcome(timestep, i, j, outcome);
+            }
+
+            if (outcome & PAIR_SUBSTEP_MASK)
+            {
+                shm->substep_checks++;
+                if ((outcome & PAIR_SUBSTEP_MASK) != PAIR_REFINED)
+                    record_substep_collision(shm, timestep, i, j, outcome & PAIR_SUBSTEP_MASK);
+            }
+
+            /* every pair is visited once per timestep and the matrix starts
+               a new generation, so only colliding pairs touch its pages */
+            if (outcome & PAIR_SAMPLED)
+            {
+
+                /* mark collision in matrix */
+                shm->collision_matrix[timestep][i][j].detected = 1;
+                shm->collision_matrix[timestep][j][i].detected = 1;
+                shm->collision_matrix[timestep][i][j].timestep_first_detected = timestep;
+                shm->collision_matrix[timestep][j][i].timestep_first_detected = timestep;
+                shm->collision_matrix[timestep][i][j].generation = shm->matrix_generation;
+                shm->collision_matrix[timestep][j][i].generation = shm->matrix_generation;
+
+                /* store collision event data */
+                CollisionEvent *collision = &shm->collision_matrix[timestep][i][j].event_data;
+                collision->timestep = timestep;
+                collision->time = timestep;
+                collision->drone1_id = i;
+                collision->drone2_id = j;
+                collision->pos1 = state_position(shm, timestep, i);
+                collision->pos2 = state_position(shm, timestep, j);
+                collision->box1 = state_box(shm, timestep, i);
+                collision->box2 = state_box(shm, timestep, j);
+
+                new_episode = track_collision_episode(shm, open_episode, collision);
+
+                /* with episode counting only the first sample of an encounter is logged */
+                if (shm->options.count_episodes && !new_episode)
+                    continue;
+
+                snprintf(str, sizeof(str),
+                         "TDrones %d and %d at timestep %d\n"
+                         " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n"
+                         " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n",
+                         i, j, timestep,
+                         i, collision->pos1.x, collision->pos1.y, collision->pos1.z,
+                         collision->box1.minX, collision->box1.maxX,
+                         collision->box1.minY, collision->box1.maxY,
+                         collision->box1.minZ, collision->box1.maxZ,
+                         j, collision->pos2.x, collision->pos2.y, collision->pos2.z,
+                         collision->box2.minX, collision->box2.maxX,
+                         collision->box2.minY, collision->box2.maxY,
+                         collision->box2.minZ, collision->box2.maxZ);
+                write(STDOUT_FILENO, str, strlen(str));
             }
         }
     }
 
+    save_collision_cache(shm);
     shm->time_indexed_collision_detection_complete = 1;
-    snprintf(str, sizeof(str), "Collision detection complete\n");
+    snprintf(str, sizeof(str), "Time-window culling: %d of %d pair-timesteps tested\n",
+             tested, shm->time_steps * shm->num_drones * (shm->num_drones - 1) / 2);
+    write(STDOUT_FILENO, str, strlen(str));
+    snprintf(str, sizeof(str), "Change tracking: %d of %d drone samples moved, %d hovering pair outcomes reused\n",
+             moved, shm->time_steps * shm->num_drones, reused);
     write(STDOUT_FILENO, str, strlen(str));
+    snprintf(str, sizeof(str), "Collision detection complete (%d episodes, %d sub-step collisions from %d refined intervals)\n",
+             shm->episode_count, shm->substep_collision_count, shm->substep_checks);
+    write(STDOUT_FILENO, str, strlen(str));
+    if (shm->substep_collisions_dropped > 0)
+    {
+        snprintf(str, sizeof(str), "Warning: %d further sub-step collisions not stored (limit %d), they are not counted\n",
+                 shm->substep_collisions_dropped, MAX_SUBSTEP_COLLISIONS);
+        write(STDOUT_FILENO, str, strlen(str));
+    }
 }
 
 void load_config(SharedMemory *shm)
 {
-    char str[256];
-    FILE *config = fopen(CONFIG_PATH, "r");
+    char str[400], config_path[300];
+
+    snprintf(config_path, sizeof(config_path), CONFIG_PATH_FORMAT, shm->options.data_dir);
+    FILE *config = fopen(config_path, "r");
     if (config)
     {
         if (fscanf(config, "%d,%d,%d,%d",
@@ -484,7 +1244,7 @@ void load_config(SharedMemory *shm)
         {
             shm->max_collisions = 5;
         }
-        snprintf(str, sizeof(str), "Configuration loaded from %s\n", CONFIG_PATH);
+        snprintf(str, sizeof(str), "Configuration loaded from %s\n", config_path);
         write(STDOUT_FILENO, str, strlen(str));
     }
     else
@@ -501,7 +1261,8 @@ void load_config(SharedMemory *shm)
 
 void load_drone_trajectory(int drone_id, SharedMemory *shm)
 {
-    char filename[100], str[350];
+    char filename[300], str[450];
+    Position staged[MAX_TIMESTEPS], *trajectory;
 
     /* bounds checking */
     if (drone_id < 0 || drone_id >= MAX_DRONES)
@@ -511,23 +1272,27 @@ void load_drone_trajectory(int drone_id, SharedMemory *shm)
         return;
     }
 
-    snprintf(filename, sizeof(filename), TRAJECTORY_PATH_FORMAT, drone_id + 1);
+    /* with -k the samples are staged here and only their keyframes are kept */
+    trajectory = shm->options.keyframes ? staged : shm->drones[drone_id].trajectory;
+
+    snprintf(filename, sizeof(filename), TRAJECTORY_PATH_FORMAT,
+             shm->options.data_dir, drone_id + 1);
     FILE *fp = fopen(filename, "r");
     if (fp)
     {
         for (int step = 0; step < shm->time_steps; step++)
         {
             if (fscanf(fp, "%f,%f,%f",
-                       &shm->drones[drone_id].trajectory[step].x,
-                       &shm->drones[drone_id].trajectory[step].y,
-                       &shm->drones[drone_id].trajectory[step].z) != 3)
+                       &trajectory[step].x,
+                       &trajectory[step].y,
+                       &trajectory[step].z) != 3)
             {
                 /*if we cannot read any more data, it will mark remaining positions as invalid */
                 for (int remaining = step; remaining < shm->time_steps; remaining++)
                 {
-                    shm->drones[drone_id].trajectory[remaining].x = 0.0f;
-                    shm->drones[drone_id].trajectory[remaining].y = 0.0f;
-                    shm->drones[drone_id].trajectory[remaining].z = 0.0f;
+                    trajectory[remaining].x = 0.0f;
+                    trajectory[remaining].y = 0.0f;
+                    trajectory[remaining].z = 0.0f;
                 }
                 break;
             }
@@ -542,16 +1307,20 @@ void load_drone_trajectory(int drone_id, SharedMemory *shm)
         write(STDOUT_FILENO, str, strlen(str));
         for (int step = 0; step < shm->time_steps; step++)
         {
-            shm->drones[drone_id].trajectory[step].x = drone_id * 10.0f + step;
-            shm->drones[drone_id].trajectory[step].y = drone_id * 10.0f;
-            shm->drones[drone_id].trajectory[step].z = 100.0f;
+            trajectory[step].x = drone_id * 10.0f + step;
+            trajectory[step].y = drone_id * 10.0f;
+            trajectory[step].z = 100.0f;
         }
     }
+
+    if (shm->options.keyframes)
+        store_keyframes(shm, drone_id, trajectory);
 }
 
 void initialise_simulation(SharedMemory *shm)
 {
     load_config(shm);
+    load_environment(shm);
 
     /* initialize simulation state */
     shm->current_timestep = 0;
@@ -560,19 +1329,18 @@ void initialise_simulation(SharedMemory *shm)
     shm->collision_detected = 0;
     shm->report_ready = 0;
     shm->active_drone_count = shm->num_drones;
-    shm->timestep_ready_for_collision = 0;
-    shm->collision_detection_complete = 0;
+    shm->detection_requested_step = 0;
+    shm->detection_completed_step = 0;
+    shm->threshold_timestep = -1;
     shm->time_indexed_collision_detection_complete = 0;
     shm->pre_calculation_complete = 0;
+    shm->step_latency_count = 0;
+    shm->paced_steps = 0;
+    shm->deadline_misses = 0;
+    memset(shm->jitter_histogram, 0, sizeof(shm->jitter_histogram));
 
-    /* tracking matrix */
-    for (int i = 0; i < MAX_DRONES; i++)
-    {
-        for (int j = 0; j < MAX_DRONES; j++)
-        {
-            shm->collision_detected_this_timestep[i][j] = 0;
-        }
-    }
+    /* a figure file replaces the per-drone trajectory files */
+    int figure_loaded = shm->options.figure_path[0] != '\0' && load_figure(shm);
 
     /* starting drones */
     for (int i = 0; i < shm->num_drones; i++)
@@ -580,26 +1348,45 @@ void initialise_simulation(SharedMemory *shm)
         shm->drones[i].active = 1;
         shm->drones[i].drone_id = i;
         shm->step_ready[i] = 0;
-        load_drone_trajectory(i, shm);
-        shm->drones[i].current_pos = shm->drones[i].trajectory[0];
+        if (!figure_loaded)
+        {
+            load_drone_trajectory(i, shm);
+        }
+        shm->drones[i].current_pos = trajectory_position(shm, i, 0);
         shm->drones[i].bounding_box = drone_bounding(
             shm->drones[i].current_pos, shm->drone_size);
     }
+    report_keyframes(shm);
 }
 
 void print_simulation_status(SharedMemory *shm)
 {
     char str[300];
+    LatencySummary latency = summarise_step_latency(shm);
+
     snprintf(str, sizeof(str), "\nSIMULATION SUMMARY\n");
     write(STDOUT_FILENO, str, strlen(str));
+    snprintf(str, sizeof(str), "Step latency (%s placement, %d steps): p50 %.1f us, p99 %.1f us, max %.1f us\n",
+             affinity_policy_name(shm->options.affinity_policy), latency.samples,
+             latency.p50 * 1e6, latency.p99 * 1e6, latency.max * 1e6);
+    write(STDOUT_FILENO, str, strlen(str));
     snprintf(str, sizeof(str), "Result: %s\n",
              (shm->collision_count >= shm->max_collisions) ? "FAILED" : "PASSED");
     write(STDOUT_FILENO, str, strlen(str));
 }
 
+double get_current_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /* cleanup function */
 void cleanup_resources(void)
 {
+    close_event_log();
+
     /* destroy mutexes and condition variables */
     pthread_mutex_destroy(&step_mutex);
     pthread_cond_destroy(&step_cond);
@@ -619,18 +1406,23 @@ void cleanup_resources(void)
     }
 
     /* removes shared memory and semaphores */
-    if (shm_unlink("/drone_sim") == -1)
+    if (shm_unlink(ipc_names.shm) == -1)
     {
         perror("shm_unlink");
     }
 
-    if (sem_unlink("/sem_step_ready") == -1)
+    if (sem_unlink(ipc_names.sem_step_ready) == -1)
     {
         perror("sem_unlink step_ready");
     }
 
-    if (sem_unlink("/sem_step_continue") == -1)
+    if (sem_unlink(ipc_names.sem_step_continue) == -1)
     {
         perror("sem_unlink step_continue");
     }
+
+    if (sem_unlink(ipc_names.sem_step_continue_odd) == -1)
+    {
+        perror("sem_unlink step_continue_odd");
+    }
 }
\ No newline at end of file
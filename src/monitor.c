@@ -0,0 +1,120 @@
+#include "../includes/simulation.h"
+#include <errno.h>
+
+/* read-only live monitor: maps the shared memory of a running simulation
+   without write access and samples the coordinator's monitor snapshot, the
+   simulation never waits for it */
+
+#define MONITOR_READ_RETRIES 1000
+
+/* seqlock reader, returns 0 if the coordinator kept writing */
+static int read_snapshot(const SharedMemory *shm, MonitorSnapshot *snapshot)
+{
+    unsigned int sequence;
+    int tries;
+
+    for (tries = 0; tries < MONITOR_READ_RETRIES; tries++)
+    {
+        if ((sequence = shm->monitor_sequence) & 1)
+            continue;
+        __sync_synchronize();
+        *snapshot = shm->monitor;
+        __sync_synchronize();
+        if (shm->monitor_sequence == sequence)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const SharedMemory *shm;
+    MonitorSnapshot now, last;
+    char name[64];
+    const char *run_id = "";
+    int fd, opt, interval_ms = 500, samples = 0, have_last = 0;
+    struct timespec pause;
+
+    while ((opt = getopt(argc, argv, "r:i:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            run_id = optarg;
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            if (interval_ms < 10)
+                interval_ms = 10;
+            break;
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-r run_id] [-i interval_ms] [-n samples]\n", argv[0]);
+            fprintf(stderr, "  -r  monitor the run started with ./drone -r run_id\n");
+            fprintf(stderr, "  -i  refresh interval in milliseconds (default 500)\n");
+            fprintf(stderr, "  -n  stop after this many samples (default until the run ends)\n");
+            exit(1);
+        }
+    }
+
+    snprintf(name, sizeof(name), SHM_NAME "%s%s", run_id[0] ? "." : "", run_id);
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+    {
+        fprintf(stderr, "No simulation running (%s): %s\n", name, strerror(errno));
+        exit(2);
+    }
+    if ((shm = mmap(NULL, sizeof(SharedMemory), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(3);
+    }
+    close(fd);
+
+    pause.tv_sec = interval_ms / 1000;
+    pause.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    printf("Monitoring %s (owner PID %d), refresh every %d ms\n", name, shm->owner_pid, interval_ms);
+    while (1)
+    {
+        if (!read_snapshot(shm, &now))
+        {
+            printf("snapshot busy, retrying\n");
+        }
+        else
+        {
+            /* rates over the last refresh interval */
+            double rate_step = 0.0, rate_second = 0.0;
+            if (have_last && now.timestep > last.timestep)
+                rate_step = (double)(now.collision_count - last.collision_count) / (now.timestep - last.timestep);
+            if (have_last && now.elapsed > last.elapsed)
+                rate_second = (now.collision_count - last.collision_count) / (now.elapsed - last.elapsed);
+
+            printf("t=%d/%d active=%d collisions=%d/%d rate=%.2f/step %.1f/s step latency=%.1f us elapsed=%.2f s\n",
+                   now.timestep, now.time_steps, now.active_drones, now.collision_count,
+                   now.max_collisions, rate_step, rate_second, now.latency * 1e6, now.elapsed);
+            fflush(stdout);
+            last = now;
+            have_last = 1;
+
+            if (now.finished)
+            {
+                printf("Simulation finished\n");
+                break;
+            }
+        }
+
+        if (shm->owner_pid > 0 && kill(shm->owner_pid, 0) == -1 && errno == ESRCH)
+        {
+            printf("Simulation process %d has exited\n", shm->owner_pid);
+            break;
+        }
+        if (samples > 0 && --samples == 0)
+            break;
+        nanosleep(&pause, NULL);
+    }
+
+    munmap((void *)shm, sizeof(SharedMemory));
+    return 0;
+}
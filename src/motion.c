@@ -0,0 +1,192 @@
+#include "../includes/simulation.h"
+
+/* change tracking over the pre-calculated states: a drone sample is unchanged
+   when the drone held the same valid position on the previous timestep. The
+   pre-calculation reuses the previous outcome of a pair of unchanged drones,
+   and in change-driven stepping (-D) the coordinator wakes only the groups
+   holding a drone that moves or finishes, while the detection thread carries
+   the colliding pairs of hovering drones over from the previous step */
+
+#define MAX_PAIRS (MAX_DRONES * (MAX_DRONES - 1) / 2)
+
+static uint8_t unchanged[MAX_TIMESTEPS][MAX_DRONES];
+static int flying[MAX_TIMESTEPS + 1];
+static int posting[MAX_TIMESTEPS + 1];
+static int wake_list[MAX_TIMESTEPS + 1][MAX_DRONES];
+static int wake_count[MAX_TIMESTEPS + 1];
+static uint16_t changed[MAX_TIMESTEPS][MAX_PAIRS];
+static int changed_count[MAX_TIMESTEPS];
+
+/* colliding pairs of the last two steps the detection thread processed */
+static uint16_t hits[2][MAX_PAIRS];
+static int hit_count[2];
+static int hit_step[2];
+static uint16_t merged[MAX_PAIRS];
+
+static int same_position(Position a, Position b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+/* a drone flies at step s while every sample up to s is valid, so it
+   finishes at its first invalid sample or at time_steps */
+static int finish_step(SharedMemory *shm, int drone_id)
+{
+    int t;
+
+    for (t = 0; t < shm->time_steps && is_state_valid(shm, t, drone_id); t++)
+        ;
+    return t;
+}
+
+/* per-step unchanged flags and, for change-driven stepping, the groups to wake
+   and the groups arriving at the barrier at every step; returns the number of
+   drone samples that moved */
+int track_motion(SharedMemory *shm)
+{
+    int finish[MAX_DRONES];
+    int size = shm->options.group_size > 0 ? shm->options.group_size : 1;
+    int groups = drone_group_count(shm);
+    int t, d, g, first, last, runs, posts, moved = 0;
+
+    for (d = 0; d < shm->num_drones; d++)
+    {
+        finish[d] = finish_step(shm, d);
+        unchanged[0][d] = 0;
+        moved += is_state_valid(shm, 0, d);
+        for (t = 1; t < shm->time_steps; t++)
+        {
+            unchanged[t][d] = is_state_valid(shm, t, d) && is_state_valid(shm, t - 1, d) &&
+                              same_position(state_position(shm, t, d), state_position(shm, t - 1, d));
+            moved += is_state_valid(shm, t, d) && !unchanged[t][d];
+        }
+    }
+
+    if (!shm->options.change_driven)
+        return moved;
+
+    /* a group runs at a step when one of its drones moves or finishes there,
+       and arrives at the barrier when one of them is still flying */
+    for (t = 0; t <= shm->time_steps; t++)
+    {
+        flying[t] = 0;
+        wake_count[t] = 0;
+        posting[t] = 0;
+        for (g = 0; g < groups; g++)
+        {
+            first = g * size;
+            last = first + size < shm->num_drones ? first + size : shm->num_drones;
+            runs = t == 0;
+            posts = 0;
+            for (d = first; d < last; d++)
+            {
+                if (t < finish[d])
+                {
+                    flying[t]++;
+                    posts = 1;
+                    runs |= !unchanged[t][d];
+                }
+                runs |= t == finish[d];
+            }
+            if (!runs)
+                continue;
+            wake_list[t][wake_count[t]++] = g;
+            posting[t] += posts;
+        }
+    }
+
+    for (g = 0; g < groups; g++)
+    {
+        if (sem_init(&shm->group_wake[g], 1, 0) == -1)
+            perror("sem_init group_wake");
+    }
+    hit_step[0] = hit_step[1] = -1;
+    return moved;
+}
+
+/* whether pair i < j at timestep has the outcome of timestep - 1: neither
+   drone moved, and with refinement neither moves to timestep + 1 either */
+int static_pair(SharedMemory *shm, int timestep, int i, int j)
+{
+    if (!unchanged[timestep][i] || !unchanged[timestep][j])
+        return 0;
+    if (shm->options.substep_margin <= 0.0f)
+        return 1;
+    return timestep + 1 < shm->time_steps && unchanged[timestep + 1][i] && unchanged[timestep + 1][j];
+}
+
+/* candidate pairs with at least one moving drone, in candidate order */
+void build_changed_pairs(SharedMemory *shm)
+{
+    const uint16_t *pairs;
+    int t, p, count;
+
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        pairs = candidate_pairs(t, &count);
+        changed_count[t] = 0;
+        for (p = 0; p < count; p++)
+        {
+            if (!unchanged[t][pairs[p] / MAX_DRONES] || !unchanged[t][pairs[p] % MAX_DRONES])
+                changed[t][changed_count[t]++] = pairs[p];
+        }
+    }
+}
+
+/* pairs the detection thread visits at timestep: the colliding pairs of the
+   previous step whose drones both hovered, merged in pair order with the
+   changed candidates; every candidate when the previous step is unknown */
+const uint16_t *detection_pairs(int timestep, int *count)
+{
+    int prev = (timestep + 1) & 1, a = 0, b = 0, n = 0;
+    const uint16_t *carried = hits[prev];
+    uint16_t pair;
+
+    hit_step[timestep & 1] = timestep;
+    hit_count[timestep & 1] = 0;
+    if (timestep == 0 || hit_step[prev] != timestep - 1)
+        return candidate_pairs(timestep, count);
+
+    while (a < hit_count[prev] || b < changed_count[timestep])
+    {
+        if (b >= changed_count[timestep] || (a < hit_count[prev] && carried[a] < changed[timestep][b]))
+        {
+            pair = carried[a++];
+            if (unchanged[timestep][pair / MAX_DRONES] && unchanged[timestep][pair % MAX_DRONES])
+                merged[n++] = pair;
+        }
+        else
+        {
+            merged[n++] = changed[timestep][b++];
+        }
+    }
+    *count = n;
+    return merged;
+}
+
+/* records a sampled collision of timestep for the carry-over of the next step */
+void note_detection_hit(int timestep, uint16_t pair)
+{
+    hits[timestep & 1][hit_count[timestep & 1]++] = pair;
+}
+
+int flying_drones(int timestep)
+{
+    return flying[timestep];
+}
+
+int posting_groups(int timestep)
+{
+    return posting[timestep];
+}
+
+/* releases the groups that run at timestep */
+void wake_groups(SharedMemory *shm, int timestep)
+{
+    int g;
+
+    for (g = 0; g < wake_count[timestep]; g++)
+    {
+        sem_post(&shm->group_wake[wake_list[timestep][g]]);
+    }
+}
@@ -0,0 +1,45 @@
+#include "../includes/simulation.h"
+
+/* fork-join helper of the in-process parallel passes (figure evaluation,
+   deconfliction moves, density binning): the work is cut into chunks that
+   share nothing, every chunk gets its own thread and the caller merges the
+   chunk results once all of them are done */
+
+/* threads for a pass over units independent items: one per online CPU, at
+   most MAX_PARALLEL_THREADS and never more than there are items */
+int parallel_thread_count(int units)
+{
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > MAX_PARALLEL_THREADS)
+        count = MAX_PARALLEL_THREADS;
+    if (count > units)
+        count = units;
+    return count < 1 ? 1 : count;
+}
+
+/* runs fn on each of the count chunks, laid out size bytes apart, and returns
+   once all of them are done; the first chunk (or one without a thread) runs
+   in the calling thread */
+void run_parallel_chunks(void *(*fn)(void *), void *chunks, int count, size_t size)
+{
+    pthread_t threads[MAX_PARALLEL_THREADS];
+    char *chunk = (char *)chunks;
+    int i, started = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i == 0 || i >= MAX_PARALLEL_THREADS ||
+            pthread_create(&threads[i], NULL, fn, chunk + i * size) != 0)
+        {
+            fn(chunk + i * size);
+            continue;
+        }
+        started |= 1 << i;
+    }
+    for (i = 1; i < count && i < MAX_PARALLEL_THREADS; i++)
+    {
+        if (started & (1 << i))
+            pthread_join(threads[i], NULL);
+    }
+}
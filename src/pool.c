@@ -0,0 +1,338 @@
+#include "../includes/simulation.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <limits.h>
+
+extern SharedMemory *shm;
+
+static sem_t *sem_pool_start;
+static sem_t *sem_pool_idle;
+static int pool_socket = -1;
+static volatile sig_atomic_t pool_stop = 0;
+
+static void pool_signal_handler(int sig)
+{
+    (void)sig;
+    pool_stop = 1;
+}
+
+/* pooled drone worker: stays attached to /drone_sim and takes a new drone ID
+   every time the daemon starts a scenario */
+static void pool_worker(void)
+{
+    int drone_id;
+    char str[100];
+
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+
+    snprintf(str, sizeof(str), "Pool worker started (PID: %d)\n", getpid());
+    write(STDOUT_FILENO, str, strlen(str));
+
+    while (1)
+    {
+        while (sem_wait(sem_pool_start) == -1 && errno == EINTR)
+            ;
+
+        if (shm->pool_shutdown)
+            break;
+
+        drone_id = __sync_fetch_and_add(&shm->pool_next_drone_id, 1);
+        run_drone(drone_id, shm);
+
+        /* tell the daemon this worker is idle again */
+        sem_post(sem_pool_idle);
+    }
+
+    snprintf(str, sizeof(str), "Pool worker ending (PID: %d)\n", getpid());
+    write(STDOUT_FILENO, str, strlen(str));
+    exit(0);
+}
+
+/* throws away wake-ups left over from drones that ended before the last release */
+static void drain_semaphore(sem_t *sem)
+{
+    while (sem_trywait(sem) == 0)
+        ;
+}
+
+static void pool_reply(int client, const char *msg)
+{
+    write(client, msg, strlen(msg));
+    write(STDOUT_FILENO, msg, strlen(msg));
+}
+
+static void pool_run_scenario(int client, const char *data_dir, SimulationOptions *options)
+{
+    int i;
+    char str[400];
+
+    mark_startup();
+    shm->options = *options;
+    shm->options.group_size = 1; /* pooled workers fly one drone each */
+    snprintf(shm->options.data_dir, sizeof(shm->options.data_dir), "%s", data_dir);
+
+    /* the drone count is all the check needs, so an oversized scenario is
+       turned away before it is loaded and pre-calculated */
+    load_config(shm);
+    if (shm->num_drones > options->pool_size)
+    {
+        snprintf(str, sizeof(str), "ERROR scenario needs %d drones but the pool has %d workers\n",
+                 shm->num_drones, options->pool_size);
+        pool_reply(client, str);
+        return;
+    }
+    prepare_simulation(shm);
+
+    /* pinned like a standalone coordinator, after the parallel pre-calculation */
+    apply_placement(pthread_self(), PLACEMENT_COORDINATOR, 0);
+    shm->pool_next_drone_id = 0;
+    start_threads();
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        sem_post(sem_pool_start);
+    }
+
+    run_timesteps(shm);
+    stop_simulation(shm);
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        while (sem_wait(sem_pool_idle) == -1 && errno == EINTR)
+            ;
+    }
+
+    join_threads();
+    release_placement(pthread_self());
+    write_trace(shm);
+    close_event_log();
+    drain_semaphore(sem_step_ready);
+    drain_semaphore(sem_step_continue);
+    drain_semaphore(sem_step_continue_odd);
+
+    print_simulation_status(shm);
+    snprintf(str, sizeof(str), "RESULT %s collisions=%d timesteps=%d data=%s\n",
+             (shm->collision_count >= shm->max_collisions) ? "FAILED" : "PASSED",
+             shm->collision_count, shm->current_timestep, data_dir);
+    pool_reply(client, str);
+}
+
+static void pool_teardown(SimulationOptions *options)
+{
+    int i;
+    char str[100];
+
+    shm->pool_shutdown = 1;
+    for (i = 0; i < options->pool_size; i++)
+    {
+        sem_post(sem_pool_start);
+    }
+    for (i = 0; i < options->pool_size; i++)
+    {
+        wait(NULL);
+    }
+
+    close(pool_socket);
+    unlink(ipc_names.pool_socket);
+
+    sem_close(sem_pool_start);
+    sem_close(sem_pool_idle);
+    if (sem_unlink(ipc_names.sem_pool_start) == -1)
+    {
+        perror("sem_unlink pool_start");
+    }
+    if (sem_unlink(ipc_names.sem_pool_idle) == -1)
+    {
+        perror("sem_unlink pool_idle");
+    }
+
+    cleanup_resources();
+
+    snprintf(str, sizeof(str), "Pool daemon stopped\n");
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* long-lived daemon: forks the drone workers once and then runs every scenario
+   requested on its control socket until an explicit shutdown */
+void pool_daemon(SimulationOptions *options)
+{
+    struct sockaddr_un addr;
+    struct sigaction act;
+    char str[400], command[320], data_dir[300];
+    pid_t pid;
+    int i, client;
+    ssize_t n;
+
+    if (options->pool_size <= 0 || options->pool_size > MAX_DRONES)
+    {
+        options->pool_size = MAX_DRONES;
+    }
+
+    /* no SA_RESTART so a signal interrupts accept() and tears the pool down */
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = pool_signal_handler;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    create_shared_memory();
+    shm->options = *options;
+    shm->pool_shutdown = 0;
+    create_synchronisation();
+    /* the daemon is only pinned while it steps a scenario, see pool_run_scenario() */
+    options->affinity_policy = plan_cpu_placement(options->affinity_policy);
+
+    if ((sem_pool_start = create_semaphore(ipc_names.sem_pool_start)) == SEM_FAILED)
+    {
+        perror("sem_open pool_start");
+        exit(16);
+    }
+
+    if ((sem_pool_idle = create_semaphore(ipc_names.sem_pool_idle)) == SEM_FAILED)
+    {
+        perror("sem_open pool_idle");
+        exit(17);
+    }
+
+    if ((pool_socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        perror("socket");
+        exit(18);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ipc_names.pool_socket);
+    /* owning the namespace's shared memory means a socket file here is stale */
+    unlink(ipc_names.pool_socket);
+    if (bind(pool_socket, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("bind");
+        exit(19);
+    }
+
+    if (listen(pool_socket, 4) == -1)
+    {
+        perror("listen");
+        exit(20);
+    }
+
+    for (i = 0; i < options->pool_size; i++)
+    {
+        pid = fork();
+        if (pid == 0)
+        {
+            close(pool_socket);
+            apply_placement(pthread_self(), PLACEMENT_DRONE, i);
+            pool_worker();
+        }
+        else if (pid < 0)
+        {
+            perror("fork");
+            exit(14);
+        }
+    }
+
+    snprintf(str, sizeof(str), "Pool daemon ready with %d workers on %s\n",
+             options->pool_size, ipc_names.pool_socket);
+    write(STDOUT_FILENO, str, strlen(str));
+
+    while (!pool_stop)
+    {
+        if ((client = accept(pool_socket, NULL, NULL)) == -1)
+        {
+            if (errno != EINTR)
+            {
+                perror("accept");
+            }
+            continue;
+        }
+
+        n = read(client, command, sizeof(command) - 1);
+        if (n <= 0)
+        {
+            close(client);
+            continue;
+        }
+        command[n] = '\0';
+        command[strcspn(command, "\r\n")] = '\0';
+
+        if (sscanf(command, "run %299s", data_dir) == 1)
+        {
+            pool_run_scenario(client, data_dir, options);
+        }
+        else if (strcmp(command, "shutdown") == 0)
+        {
+            pool_reply(client, "OK shutting down\n");
+            pool_stop = 1;
+        }
+        else
+        {
+            snprintf(str, sizeof(str), "ERROR unknown command '%s'\n", command);
+            pool_reply(client, str);
+        }
+        close(client);
+    }
+
+    pool_teardown(options);
+}
+
+/* sends one command to the pool daemon and prints its reply */
+int pool_client(const char *command, SimulationOptions *options)
+{
+    struct sockaddr_un addr;
+    char request[PATH_MAX + 8], reply[400], data_dir[PATH_MAX];
+    int fd, failed = 0;
+    ssize_t n;
+
+    if (strcmp(command, "run") == 0)
+    {
+        /* the daemon has its own working directory */
+        if (realpath(options->data_dir, data_dir) == NULL)
+        {
+            perror("realpath");
+            return 1;
+        }
+        snprintf(request, sizeof(request), "run %s\n", data_dir);
+    }
+    else if (strcmp(command, "shutdown") == 0)
+    {
+        snprintf(request, sizeof(request), "shutdown\n");
+    }
+    else
+    {
+        fprintf(stderr, "Unknown pool command '%s' (expected run or shutdown)\n", command);
+        return 1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ipc_names.pool_socket);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("connect");
+        close(fd);
+        return 1;
+    }
+
+    write(fd, request, strlen(request));
+    while ((n = read(fd, reply, sizeof(reply) - 1)) > 0)
+    {
+        reply[n] = '\0';
+        if (strncmp(reply, "ERROR", 5) == 0)
+        {
+            failed = 1;
+        }
+        write(STDOUT_FILENO, reply, n);
+    }
+
+    close(fd);
+    return failed;
+}
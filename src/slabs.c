@@ -0,0 +1,187 @@
+#include "../includes/simulation.h"
+
+/* spatial decomposition of the pair evaluation: the flight volume is cut
+   along x into slabs holding equal numbers of drone samples, and one forked
+   worker per slab evaluates the pairs it owns into shm->slab_outcome.
+
+   At timestep t a drone covers the x interval swept between t and t + 1,
+   widened by half the drone size plus half the sub-step margin, so two drones
+   can only collide or need refinement when their intervals overlap. A pair is
+   owned by the slab holding the start of that overlap, which lies inside both
+   intervals: every worker sees the drones whose interval reaches into its
+   slab (its own drones plus a ghost zone on either border) and each pair is
+   evaluated exactly once. */
+
+static float slab_bound[MAX_SLABS + 1];
+static int slab_count;
+
+static int compare_float(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/* swept x interval of drone_id at timestep, returns 0 when it is not flying */
+static int swept_interval(SharedMemory *shm, int timestep, int drone_id, float *lo, float *hi)
+{
+    float half = shm->drone_size / 2.0f + shm->options.substep_margin / 2.0f;
+    float x0, x1;
+
+    if (!is_state_valid(shm, timestep, drone_id))
+        return 0;
+
+    /* quantised boxes may round up by one grid unit */
+    if (shm->options.quantised_states)
+        half += shm->quantisation_scale;
+
+    x0 = x1 = state_position(shm, timestep, drone_id).x;
+    if (shm->options.substep_margin > 0.0f && timestep + 1 < shm->time_steps &&
+        is_state_valid(shm, timestep + 1, drone_id))
+        x1 = state_position(shm, timestep + 1, drone_id).x;
+
+    *lo = fminf(x0, x1) - half;
+    *hi = fmaxf(x0, x1) + half;
+    return 1;
+}
+
+static int slab_of(float x)
+{
+    int s = 0;
+
+    while (s < slab_count - 1 && x >= slab_bound[s + 1])
+        s++;
+    return s;
+}
+
+/* slab owning pair i, j at timestep, -1 when their intervals are apart */
+static int pair_owner(SharedMemory *shm, int timestep, int i, int j)
+{
+    float lo_i, hi_i, lo_j, hi_j, start;
+
+    if (!swept_interval(shm, timestep, i, &lo_i, &hi_i) ||
+        !swept_interval(shm, timestep, j, &lo_j, &hi_j))
+        return -1;
+
+    start = fmaxf(lo_i, lo_j);
+    if (start > fminf(hi_i, hi_j))
+        return -1;
+    return slab_of(start);
+}
+
+/* slab borders at quantiles of the sampled x positions, so each worker gets
+   about the same number of drone samples */
+static void plan_slabs(SharedMemory *shm)
+{
+    static float xs[MAX_TIMESTEPS * MAX_DRONES];
+    int t, i, s, n = 0;
+
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        for (i = 0; i < shm->num_drones; i++)
+        {
+            if (is_state_valid(shm, t, i))
+                xs[n++] = state_position(shm, t, i).x;
+        }
+    }
+    qsort(xs, n, sizeof(float), compare_float);
+
+    slab_count = shm->options.slabs;
+    slab_bound[0] = -INFINITY;
+    slab_bound[slab_count] = INFINITY;
+    for (s = 1; s < slab_count; s++)
+    {
+        slab_bound[s] = n > 0 ? xs[(long)n * s / slab_count] : 0.0f;
+    }
+}
+
+static void slab_worker(SharedMemory *shm, int slab)
+{
+    int local[MAX_DRONES];
+    int t, i, a, b, d, count, home;
+    float lo, hi;
+
+    shm->slab_pairs[slab] = 0;
+    shm->slab_ghosts[slab] = 0;
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        /* drones of this slab and the ghosts whose interval crosses a border */
+        count = 0;
+        for (d = 0; d < shm->num_drones; d++)
+        {
+            if (!swept_interval(shm, t, d, &lo, &hi))
+                continue;
+            if (lo >= slab_bound[slab + 1] || hi < slab_bound[slab])
+                continue;
+            home = slab_of(state_position(shm, t, d).x);
+            if (home != slab)
+                shm->slab_ghosts[slab]++;
+            local[count++] = d;
+        }
+
+        for (a = 0; a < count - 1; a++)
+        {
+            i = local[a];
+            for (b = a + 1; b < count; b++)
+            {
+                /* cached pairs are merged by the coordinator directly */
+                if (cached_pair_outcome(t, i, local[b]) >= 0 ||
+                    pair_owner(shm, t, i, local[b]) != slab)
+                    continue;
+                /* a hovering pair keeps the outcome this slab gave it before */
+                shm->slab_outcome[t][i][local[b]] = t > 0 && static_pair(shm, t, i, local[b])
+                                                        ? shm->slab_outcome[t - 1][i][local[b]]
+                                                        : evaluate_pair(shm, t, i, local[b]);
+                shm->slab_pairs[slab]++;
+            }
+        }
+    }
+}
+
+/* forks one worker per slab and waits for all of them; a slab whose worker
+   cannot be started is evaluated by the caller */
+void run_slab_workers(SharedMemory *shm)
+{
+    pid_t pids[MAX_SLABS];
+    char str[300];
+    int s, len, total = 0, ghosts = 0;
+
+    plan_slabs(shm);
+    for (s = 0; s < slab_count; s++)
+    {
+        pids[s] = fork();
+        if (pids[s] == 0)
+        {
+            slab_worker(shm, s);
+            _exit(0);
+        }
+        else if (pids[s] < 0)
+        {
+            perror("fork slab worker");
+            slab_worker(shm, s);
+        }
+    }
+    for (s = 0; s < slab_count; s++)
+    {
+        if (pids[s] > 0)
+            waitpid(pids[s], NULL, 0);
+        total += shm->slab_pairs[s];
+        ghosts += shm->slab_ghosts[s];
+    }
+
+    len = snprintf(str, sizeof(str), "Slab decomposition: %d workers, %d pairs evaluated (", slab_count, total);
+    for (s = 0; s < slab_count && len < (int)sizeof(str) - 16; s++)
+    {
+        len += snprintf(str + len, sizeof(str) - len, "%s%d", s ? "/" : "", shm->slab_pairs[s]);
+    }
+    snprintf(str + len, sizeof(str) - len, "), %d ghost samples\n", ghosts);
+    write(STDOUT_FILENO, str, strlen(str));
+}
+
+/* outcome of pair i < j at timestep from the slab workers; pairs whose
+   intervals are apart can neither collide nor need refinement */
+int slab_pair_outcome(SharedMemory *shm, int timestep, int i, int j)
+{
+    if (pair_owner(shm, timestep, i, j) < 0)
+        return 0;
+    return shm->slab_outcome[timestep][i][j];
+}
@@ -0,0 +1,342 @@
+#include "../includes/simulation.h"
+#include <errno.h>
+
+/* deconfliction over the pre-calculated states: every drone may start up to
+   SOLVER_MAX_DELAY timesteps late (holding its first position) and/or fly
+   SOLVER_ALTITUDE_LEVELS - 1 altitude steps higher; the run keeps time_steps
+   rows, so a drone is only delayed by as many timesteps as it already spends
+   landed at the end of the run and never loses a valid sample; a greedy
+   search applies the single drone shift that removes the most colliding
+   samples until the figure is under max_collisions */
+
+#define SOLVER_MAX_DELAY 8
+#define SOLVER_ALTITUDE_LEVELS 4
+#define SOLVER_CANDIDATES ((SOLVER_MAX_DELAY + 1) * SOLVER_ALTITUDE_LEVELS)
+#define MAX_SOLVER_ROUNDS 200
+
+typedef struct
+{
+    int delay;
+    int level;
+} DroneShift;
+
+/* one slice of the (drone, candidate) moves, evaluated by one thread */
+typedef struct
+{
+    SharedMemory *shm;
+    int first_move;
+    int last_move;
+    int best_move;
+    int best_delta;
+} SolverChunk;
+
+static DroneShift shift[MAX_DRONES];
+static DroneShift candidates[SOLVER_CANDIDATES];
+static int neighbours[MAX_DRONES][MAX_DRONES];
+static int neighbour_count[MAX_DRONES];
+static int delay_room[MAX_DRONES];
+static int pair_cost[MAX_DRONES][MAX_DRONES];
+static int move_drone[MAX_DRONES * SOLVER_CANDIDATES];
+static int move_candidate[MAX_DRONES * SOLVER_CANDIDATES];
+static float altitude_step;
+
+/* position of a shifted drone at timestep t, returns 0 when it is not flying */
+static int shifted_position(SharedMemory *shm, int drone_id, int t, DroneShift s, Position *pos)
+{
+    int source = t - s.delay;
+
+    if (source < 0)
+        source = 0;
+    if (!is_state_valid(shm, source, drone_id))
+        return 0;
+
+    *pos = state_position(shm, source, drone_id);
+    pos->z += s.level * altitude_step;
+    return 1;
+}
+
+/* trailing timesteps without a valid position, the largest delay that keeps
+   every valid sample of the drone inside the run */
+static int trailing_idle_steps(SharedMemory *shm, int drone_id)
+{
+    int t, idle = 0;
+
+    for (t = shm->time_steps - 1; t >= 0 && idle < SOLVER_MAX_DELAY; t--, idle++)
+    {
+        if (is_state_valid(shm, t, drone_id))
+            break;
+    }
+    return idle;
+}
+
+/* colliding samples of a pair under the given shifts */
+static int shifted_pair_cost(SharedMemory *shm, int i, DroneShift si, int j, DroneShift sj)
+{
+    Position a, b;
+    int t, cost = 0;
+
+    for (t = 0; t < shm->time_steps; t++)
+    {
+        if (shifted_position(shm, i, t, si, &a) && shifted_position(shm, j, t, sj, &b) &&
+            intersect(drone_bounding(a, shm->drone_size), drone_bounding(b, shm->drone_size)))
+            cost++;
+    }
+    return cost;
+}
+
+/* pairwise proximity index: delays only reorder a drone's positions and the
+   altitude steps only move it along z, so two drones whose horizontal extents
+   over the whole run never overlap can be ignored for every candidate */
+static void build_proximity_index(SharedMemory *shm)
+{
+    DroneAABB extent[MAX_DRONES], box;
+    Position pos;
+    int i, j, t, flying[MAX_DRONES];
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        flying[i] = 0;
+        for (t = 0; t < shm->time_steps; t++)
+        {
+            if (!shifted_position(shm, i, t, shift[i], &pos))
+                continue;
+            box = drone_bounding(pos, shm->drone_size);
+            if (!flying[i]++)
+            {
+                extent[i] = box;
+                continue;
+            }
+            extent[i].minX = fminf(extent[i].minX, box.minX);
+            extent[i].maxX = fmaxf(extent[i].maxX, box.maxX);
+            extent[i].minY = fminf(extent[i].minY, box.minY);
+            extent[i].maxY = fmaxf(extent[i].maxY, box.maxY);
+        }
+        neighbour_count[i] = 0;
+    }
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        for (j = 0; j < shm->num_drones; j++)
+        {
+            pair_cost[i][j] = 0;
+            if (j == i || !flying[i] || !flying[j] ||
+                extent[i].minX > extent[j].maxX || extent[i].maxX < extent[j].minX ||
+                extent[i].minY > extent[j].maxY || extent[i].maxY < extent[j].minY)
+                continue;
+
+            neighbours[i][neighbour_count[i]++] = j;
+            if (j < i)
+                pair_cost[i][j] = pair_cost[j][i];
+            else
+                pair_cost[i][j] = shifted_pair_cost(shm, i, shift[i], j, shift[j]);
+        }
+    }
+}
+
+/* change in colliding samples when drone i takes candidate shift s */
+static int move_delta(SharedMemory *shm, int i, DroneShift s)
+{
+    int n, j, delta = 0;
+
+    for (n = 0; n < neighbour_count[i]; n++)
+    {
+        j = neighbours[i][n];
+        delta += shifted_pair_cost(shm, i, s, j, shift[j]) - pair_cost[i][j];
+    }
+    return delta;
+}
+
+static void *evaluate_moves(void *arg)
+{
+    SolverChunk *chunk = (SolverChunk *)arg;
+    int m, delta;
+
+    chunk->best_move = -1;
+    chunk->best_delta = 0;
+    for (m = chunk->first_move; m < chunk->last_move; m++)
+    {
+        delta = move_delta(chunk->shm, move_drone[m], candidates[move_candidate[m]]);
+        if (delta < chunk->best_delta)
+        {
+            chunk->best_delta = delta;
+            chunk->best_move = m;
+        }
+    }
+    return NULL;
+}
+
+/* evaluates every move in parallel and returns the best one (lowest delta,
+   then lowest index), -1 when no move removes a collision */
+static int best_move(SharedMemory *shm, int move_count, int thread_count)
+{
+    SolverChunk chunks[MAX_PARALLEL_THREADS];
+    int i, best = -1, best_delta = 0;
+
+    for (i = 0; i < thread_count; i++)
+    {
+        chunks[i].shm = shm;
+        chunks[i].first_move = move_count * i / thread_count;
+        chunks[i].last_move = move_count * (i + 1) / thread_count;
+    }
+    run_parallel_chunks(evaluate_moves, chunks, thread_count, sizeof(SolverChunk));
+
+    for (i = 0; i < thread_count; i++)
+    {
+        if (chunks[i].best_move >= 0 && chunks[i].best_delta < best_delta)
+        {
+            best_delta = chunks[i].best_delta;
+            best = chunks[i].best_move;
+        }
+    }
+    return best;
+}
+
+static void apply_move(SharedMemory *shm, int i, DroneShift s)
+{
+    int n, j;
+
+    shift[i] = s;
+    for (n = 0; n < neighbour_count[i]; n++)
+    {
+        j = neighbours[i][n];
+        pair_cost[i][j] = pair_cost[j][i] = shifted_pair_cost(shm, i, shift[i], j, shift[j]);
+    }
+}
+
+static int total_cost(SharedMemory *shm)
+{
+    int i, j, cost = 0;
+
+    for (i = 0; i < shm->num_drones - 1; i++)
+    {
+        for (j = i + 1; j < shm->num_drones; j++)
+        {
+            cost += pair_cost[i][j];
+        }
+    }
+    return cost;
+}
+
+/* writes info.csv and the shifted movement files into the solver directory */
+static int write_solution(SharedMemory *shm)
+{
+    const char *dir = shm->options.solve_dir;
+    char path[400];
+    Position pos;
+    FILE *fp;
+    int i, t;
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+    {
+        perror("mkdir solver directory");
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), CONFIG_PATH_FORMAT, dir);
+    if (!(fp = fopen(path, "w")))
+    {
+        perror("fopen solver info.csv");
+        return 0;
+    }
+    fprintf(fp, "%d,%d,%d,%d\n", shm->num_drones, shm->drone_size,
+            shm->max_collisions, shm->time_steps);
+    fclose(fp);
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        snprintf(path, sizeof(path), TRAJECTORY_PATH_FORMAT, dir, i + 1);
+        if (!(fp = fopen(path, "w")))
+        {
+            perror("fopen solver trajectory");
+            return 0;
+        }
+        for (t = 0; t < shm->time_steps; t++)
+        {
+            if (shifted_position(shm, i, t, shift[i], &pos))
+                fprintf(fp, "%g,%g,%g\n", pos.x, pos.y, pos.z);
+            else
+                fprintf(fp, "0,0,0\n");
+        }
+        fclose(fp);
+    }
+    return 1;
+}
+
+/* greedy search for start delays and altitude offsets that bring the
+   collision count under max_collisions; returns 1 when it succeeds */
+int solve_deconfliction(SharedMemory *shm)
+{
+    int i, c, m, round, cost, initial, move_count, thread_count;
+    char str[400];
+
+    altitude_step = 2.0f * shm->drone_size;
+    for (c = 0; c < SOLVER_CANDIDATES; c++)
+    {
+        /* ordered so that smaller adjustments win ties */
+        candidates[c].delay = c % (SOLVER_MAX_DELAY + 1);
+        candidates[c].level = c / (SOLVER_MAX_DELAY + 1);
+    }
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        shift[i].delay = 0;
+        shift[i].level = 0;
+        delay_room[i] = trailing_idle_steps(shm, i);
+    }
+
+    thread_count = parallel_thread_count(shm->num_drones * SOLVER_CANDIDATES);
+
+    build_proximity_index(shm);
+    initial = cost = total_cost(shm);
+    snprintf(str, sizeof(str), "Solver: %d colliding samples, target below %d (%d threads)\n",
+             cost, shm->max_collisions, thread_count);
+    write(STDOUT_FILENO, str, strlen(str));
+
+    for (round = 0; round < MAX_SOLVER_ROUNDS && cost >= shm->max_collisions; round++)
+    {
+        /* only drones that still collide are moved */
+        move_count = 0;
+        for (i = 0; i < shm->num_drones; i++)
+        {
+            int involved = 0;
+            for (m = 0; m < neighbour_count[i]; m++)
+                involved += pair_cost[i][neighbours[i][m]];
+            if (!involved)
+                continue;
+            for (c = 0; c < SOLVER_CANDIDATES; c++)
+            {
+                if (candidates[c].delay == shift[i].delay && candidates[c].level == shift[i].level)
+                    continue;
+                /* a longer delay would push valid samples past the last row */
+                if (candidates[c].delay > delay_room[i])
+                    continue;
+                move_drone[move_count] = i;
+                move_candidate[move_count++] = c;
+            }
+        }
+
+        if ((m = best_move(shm, move_count, thread_count)) < 0)
+            break;
+        apply_move(shm, move_drone[m], candidates[move_candidate[m]]);
+        cost = total_cost(shm);
+    }
+
+    for (i = 0; i < shm->num_drones; i++)
+    {
+        if (shift[i].delay == 0 && shift[i].level == 0)
+            continue;
+        snprintf(str, sizeof(str), "Solver: drone %d delayed %d timesteps, raised %.1f\n",
+                 i + 1, shift[i].delay, shift[i].level * altitude_step);
+        write(STDOUT_FILENO, str, strlen(str));
+    }
+
+    snprintf(str, sizeof(str), "Solver: %d -> %d colliding samples after %d adjustments\n",
+             initial, cost, round);
+    write(STDOUT_FILENO, str, strlen(str));
+
+    if (!write_solution(shm))
+        return 0;
+    snprintf(str, sizeof(str), "Result: %s, adjusted trajectories written to %s\n",
+             cost < shm->max_collisions ? "SOLVED" : "UNSOLVED", shm->options.solve_dir);
+    write(STDOUT_FILENO, str, strlen(str));
+    return cost < shm->max_collisions;
+}
@@ -1,25 +1,102 @@
 #include "../includes/simulation.h"
+#include <sched.h>
 
 extern pthread_mutex_t collision_mutex;
 extern pthread_cond_t collision_cond;
 extern pthread_mutex_t step_mutex;
 extern pthread_cond_t step_cond;
 
+/* with episode counting only the first timestep of an encounter is an event */
+static int is_collision_event(SharedMemory *shm, int timestep, int i, int j)
+{
+    int id = shm->collision_matrix[timestep][i][j].episode_id;
+
+    if (!shm->options.count_episodes || id < 0)
+        return 1;
+    return shm->episodes[id].start_timestep == timestep;
+}
+
+/* detection thread's working copy of the step summary and the collision
+   total after every processed step for the rolling rate */
+static StepCollisionSummary step_summary;
+static int step_totals[MAX_TIMESTEPS];
+
+static void count_step_collision(CollisionEvent *collision)
+{
+    step_summary.new_collisions++;
+    step_summary.drone_hits[collision->drone1_id]++;
+    step_summary.drone_hits[collision->drone2_id]++;
+}
+
+/* seqlock writer: copies the working summary into shared memory and wakes
+   the report thread once for the whole step */
+static void publish_step_summary(SharedMemory *shm, int step)
+{
+    step_summary.timestep = step;
+    step_summary.total_collisions = shm->collision_count;
+    step_summary.threshold_margin = shm->max_collisions - shm->collision_count;
+    step_summary.window_steps = step < COLLISION_RATE_WINDOW ? step : COLLISION_RATE_WINDOW;
+    step_summary.window_collisions = shm->collision_count - step_totals[step - step_summary.window_steps];
+
+    shm->summary_sequence++;
+    __sync_synchronize();
+    shm->step_summary = step_summary;
+    __sync_synchronize();
+    shm->summary_sequence++;
+
+    pthread_mutex_lock(&collision_mutex);
+    shm->collision_detected = 1;
+    pthread_cond_signal(&collision_cond);
+    pthread_mutex_unlock(&collision_mutex);
+}
+
+/* seqlock reader: retries until it copied a summary no write overlapped */
+static void read_step_summary(SharedMemory *shm, StepCollisionSummary *summary)
+{
+    unsigned int sequence;
+
+    do
+    {
+        while ((sequence = shm->summary_sequence) & 1)
+            sched_yield();
+        __sync_synchronize();
+        *summary = shm->step_summary;
+        __sync_synchronize();
+    } while (shm->summary_sequence != sequence);
+}
+
+/* publishes the collision count of a processed step and wakes the coordinator */
+static void complete_detection_step(SharedMemory *shm, int step)
+{
+    pthread_mutex_lock(&step_mutex);
+    shm->pipeline[step % PIPELINE_SLOTS].collision_count = shm->collision_count;
+    shm->detection_completed_step = step;
+    pthread_cond_broadcast(&step_cond);
+    pthread_mutex_unlock(&step_mutex);
+}
+
 /* US362 & US363: */
 void *collision_detection_thread(void *arg)
 {
     SharedMemory *shm = (SharedMemory *)arg;
-    int i, j;
+    const uint16_t *pairs;
+    int i, j, p, pair_count;
     char str[200];
 
     snprintf(str, sizeof(str), "Collision detection thread started (ID: %u)\n",
              (unsigned int)pthread_self());
     write(STDOUT_FILENO, str, strlen(str));
 
+    memset(&step_summary, 0, sizeof(step_summary));
+    memset(step_totals, 0, sizeof(step_totals));
+
     while (!shm->simulation_finished)
     {
+        /* take the next step handed over by the coordinator, steps are
+           processed strictly in order */
         pthread_mutex_lock(&step_mutex);
-        while (!shm->timestep_ready_for_collision && !shm->simulation_finished)
+        while (shm->detection_completed_step >= shm->detection_requested_step &&
+               !shm->simulation_finished)
         {
             pthread_cond_wait(&step_cond, &step_mutex);
         }
@@ -29,89 +106,121 @@ void *collision_detection_thread(void *arg)
             pthread_mutex_unlock(&step_mutex);
             break;
         }
+        int current_step = shm->detection_completed_step + 1;
         pthread_mutex_unlock(&step_mutex);
 
-        int current_step = shm->current_timestep;
-
         /* bounds checking */
         if (current_step < 0 || current_step >= MAX_TIMESTEPS)
         {
             printf("Warning: Invalid timestep %d\n", current_step);
-            pthread_mutex_lock(&step_mutex);
-            shm->collision_detection_complete = 1;
-            pthread_cond_signal(&step_cond);
-            pthread_mutex_unlock(&step_mutex);
+            complete_detection_step(shm, current_step);
             continue;
         }
 
-        if (current_step < shm->time_steps)
+        trace_event(shm, TRACE_DETECTION, TRACE_DETECT_START, current_step - 1);
+
+        /* pair flags of the previous step stop counting */
+        shm->pair_flag_generation++;
+        step_summary.new_collisions = 0;
+
+        /* nothing is counted after the step that exceeded the threshold */
+        if (current_step < shm->time_steps && shm->threshold_timestep < 0)
         {
-            /* check time-indexed collision matrix for current timestep */
-            for (i = 0; i < shm->num_drones - 1; i++)
+            /* only sampled collisions among the pairs that survived culling
+               are in the collision matrix, no other entry is ever read */
+            pairs = shm->options.change_driven ? detection_pairs(current_step, &pair_count)
+                                               : candidate_pairs(current_step, &pair_count);
+            for (p = 0; p < pair_count; p++)
             {
-                if (!shm->time_indexed_states[current_step][i].is_valid)
+                i = pairs[p] / MAX_DRONES;
+                j = pairs[p] % MAX_DRONES;
+                if (!(current_pair_outcome(current_step, i, j) & PAIR_SAMPLED))
                     continue;
+                if (!is_state_valid(shm, current_step, i) || !is_state_valid(shm, current_step, j))
+                    continue;
+                if (shm->options.change_driven)
+                    note_detection_hit(current_step, pairs[p]);
 
-                for (j = i + 1; j < shm->num_drones; j++)
+                if (pair_detected(shm, current_step, i, j) &&
+                    shm->collision_matrix[current_step][i][j].timestep_first_detected == current_step &&
+                    is_collision_event(shm, current_step, i, j))
                 {
-                    if (j < 0 || j >= MAX_DRONES)
-                        continue;
-
-                    if (!shm->time_indexed_states[current_step][j].is_valid)
-                        continue;
-
-                    if (shm->collision_matrix[current_step][i][j].detected &&
-                        shm->collision_matrix[current_step][i][j].timestep_first_detected == current_step)
+                    if (shm->collision_detected_this_timestep[i][j] != shm->pair_flag_generation)
                     {
+                        shm->collision_detected_this_timestep[i][j] = shm->pair_flag_generation;
+                        shm->collision_detected_this_timestep[j][i] = shm->pair_flag_generation;
+
+                        if (shm->collision_count >= MAX_COLLISIONS)
+                        {
+                            snprintf(str, sizeof(str), "Warning: Maximum collision count reached\n");
+                            write(STDOUT_FILENO, str, strlen(str));
+                            break;
+                        }
 
-                        if (shm->collision_detected_this_timestep[i][j] == 0)
+                        if (shm->collision_count < MAX_COLLISIONS)
                         {
-                            shm->collision_detected_this_timestep[i][j] = 1;
-                            shm->collision_detected_this_timestep[j][i] = 1;
-
-                            if (shm->collision_count >= MAX_COLLISIONS)
-                            {
-                                snprintf(str, sizeof(str), "Warning: Maximum collision count reached\n");
-                                write(STDOUT_FILENO, str, strlen(str));
-                                break;
-                            }
-
-                            if (shm->collision_count < MAX_COLLISIONS)
-                            {
-                                CollisionEvent *collision = &shm->collisions[shm->collision_count];
-                                *collision = shm->collision_matrix[current_step][i][j].event_data;
-                                shm->collision_count++;
-
-                                snprintf(str, sizeof(str),
-                                         "COLLISION CONFIRMED! Drones %d and %d at timestep %d\n"
-                                         " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n"
-                                         " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n",
-                                         i, j, current_step,
-                                         i, collision->pos1.x, collision->pos1.y, collision->pos1.z,
-                                         collision->box1.minX, collision->box1.maxX,
-                                         collision->box1.minY, collision->box1.maxY,
-                                         collision->box1.minZ, collision->box1.maxZ,
-                                         j, collision->pos2.x, collision->pos2.y, collision->pos2.z,
-                                         collision->box2.minX, collision->box2.maxX,
-                                         collision->box2.minY, collision->box2.maxY,
-                                         collision->box2.minZ, collision->box2.maxZ);
-                                write(STDOUT_FILENO, str, strlen(str));
-
-                                pthread_mutex_lock(&collision_mutex);
-                                shm->collision_detected = 1;
-                                pthread_cond_signal(&collision_cond);
-                                pthread_mutex_unlock(&collision_mutex);
-                            }
+                            CollisionEvent *collision = &shm->collisions[shm->collision_count];
+                            *collision = shm->collision_matrix[current_step][i][j].event_data;
+                            shm->collision_count++;
+                            log_collision_event(collision);
+
+                            snprintf(str, sizeof(str),
+                                     "COLLISION CONFIRMED! Drones %d and %d at timestep %d\n"
+                                     " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n"
+                                     " Drone %d: pos(%.1f,%.1f,%.1f) box[%.1f-%.1f,%.1f-%.1f,%.1f-%.1f]\n",
+                                     i, j, current_step,
+                                     i, collision->pos1.x, collision->pos1.y, collision->pos1.z,
+                                     collision->box1.minX, collision->box1.maxX,
+                                     collision->box1.minY, collision->box1.maxY,
+                                     collision->box1.minZ, collision->box1.maxZ,
+                                     j, collision->pos2.x, collision->pos2.y, collision->pos2.z,
+                                     collision->box2.minX, collision->box2.maxX,
+                                     collision->box2.minY, collision->box2.maxY,
+                                     collision->box2.minZ, collision->box2.maxZ);
+                            write(STDOUT_FILENO, str, strlen(str));
+                            count_step_collision(collision);
                         }
                     }
                 }
             }
+
+            /* sub-step collisions between the previous and the current timestep */
+            for (i = 0; i < shm->substep_collision_count; i++)
+            {
+                if (shm->substep_collisions[i].timestep + 1 != current_step)
+                    continue;
+
+                if (shm->collision_count >= MAX_COLLISIONS)
+                {
+                    snprintf(str, sizeof(str), "Warning: Maximum collision count reached\n");
+                    write(STDOUT_FILENO, str, strlen(str));
+                    break;
+                }
+
+                CollisionEvent *collision = &shm->collisions[shm->collision_count];
+                *collision = shm->substep_collisions[i];
+                shm->collision_count++;
+                log_collision_event(collision);
+
+                snprintf(str, sizeof(str),
+                         "COLLISION CONFIRMED! Drones %d and %d at timestep %.3f (sub-step)\n",
+                         collision->drone1_id, collision->drone2_id, collision->time);
+                write(STDOUT_FILENO, str, strlen(str));
+                count_step_collision(collision);
+            }
         }
 
-        pthread_mutex_lock(&step_mutex);
-        shm->collision_detection_complete = 1;
-        pthread_cond_signal(&step_cond);
-        pthread_mutex_unlock(&step_mutex);
+        step_totals[current_step] = shm->collision_count;
+        if (step_summary.new_collisions > 0)
+        {
+            publish_step_summary(shm, current_step);
+        }
+        if (shm->collision_count >= shm->max_collisions && shm->threshold_timestep < 0)
+        {
+            shm->threshold_timestep = current_step;
+        }
+        trace_event(shm, TRACE_DETECTION, TRACE_DETECT_END, current_step - 1);
+        complete_detection_step(shm, current_step);
     }
 
     snprintf(str, sizeof(str), "time-indexed collision detection thread ending\n");
@@ -123,15 +232,18 @@ void *collision_detection_thread(void *arg)
 void *report_generation_thread(void *arg)
 {
     SharedMemory *shm = (SharedMemory *)arg;
-    char str[200];
+    char str[300];
 
     snprintf(str, sizeof(str), "report generation thread started (ID: %u)\n",
              (unsigned int)pthread_self());
     write(STDOUT_FILENO, str, strlen(str));
 
+    StepCollisionSummary summary;
+    int i, busiest, last_step = 0;
+
     while (!shm->simulation_finished)
     {
-        /* US363: wait for collision notification*/
+        /* US363: wait for collision notification, sent once per step */
         pthread_mutex_lock(&collision_mutex);
         while (!shm->collision_detected && !shm->simulation_finished)
         {
@@ -143,34 +255,38 @@ void *report_generation_thread(void *arg)
             pthread_mutex_unlock(&collision_mutex);
             break;
         }
+        shm->collision_detected = 0;
+        pthread_mutex_unlock(&collision_mutex);
 
-        if (shm->collision_detected)
-        {
+        /* the summary itself is read without the mutex */
+        read_step_summary(shm, &summary);
+        trace_event(shm, TRACE_REPORT, TRACE_REPORT_WAKE, summary.timestep - 1);
+        if (summary.timestep <= last_step)
+            continue;
+        last_step = summary.timestep;
 
-            if (shm->collision_count < 0 || shm->collision_count > MAX_COLLISIONS)
-            {
-                snprintf(str, sizeof(str), "Warning: Invalid collision count %d\n", shm->collision_count);
-                write(STDOUT_FILENO, str, strlen(str));
-            }
-            else
-            {
-                snprintf(str, sizeof(str),
-                         "Report thread: Processing collision event (total: %d/%d)\n",
-                         shm->collision_count, shm->max_collisions);
-                write(STDOUT_FILENO, str, strlen(str));
-            }
+        busiest = 0;
+        for (i = 1; i < shm->num_drones; i++)
+        {
+            if (summary.drone_hits[i] > summary.drone_hits[busiest])
+                busiest = i;
+        }
 
-            if (shm->collision_count >= shm->max_collisions)
-            {
-                snprintf(str, sizeof(str),
-                         "CRITICAL: Collision threshold reached!\n");
-                write(STDOUT_FILENO, str, strlen(str));
-            }
+        snprintf(str, sizeof(str),
+                 "Report thread: step %d, %d new collisions (total: %d/%d, margin %d), "
+                 "%.2f/step over the last %d steps, most hit drone %d (%d)\n",
+                 summary.timestep, summary.new_collisions, summary.total_collisions,
+                 shm->max_collisions, summary.threshold_margin,
+                 (double)summary.window_collisions / summary.window_steps,
+                 summary.window_steps, busiest, summary.drone_hits[busiest]);
+        write(STDOUT_FILENO, str, strlen(str));
 
-            shm->collision_detected = 0;
+        if (summary.threshold_margin <= 0)
+        {
+            snprintf(str, sizeof(str),
+                     "CRITICAL: Collision threshold reached!\n");
+            write(STDOUT_FILENO, str, strlen(str));
         }
-
-        pthread_mutex_unlock(&collision_mutex);
     }
 
     /* US365: generate final report when simulation ends */
@@ -182,14 +298,78 @@ void *report_generation_thread(void *arg)
     pthread_exit(NULL);
 }
 
+/* last timestep whose collisions were counted: the step that crossed the
+   threshold, even when a pipelined run had already moved the drones past it */
+int last_counted_step(SharedMemory *shm)
+{
+    if (shm->threshold_timestep >= 0 && shm->threshold_timestep < shm->current_timestep)
+        return shm->threshold_timestep;
+    return shm->current_timestep;
+}
+
+/* an episode cut at the last counted step: its samples and minimum separation
+   are recounted from the collision matrix entries up to that step */
+static CollisionEpisode clamp_episode(SharedMemory *shm, const CollisionEpisode *episode, int last_step)
+{
+    CollisionEpisode clamped = *episode;
+    CollisionEvent *event;
+    float dx, dy, dz, separation;
+    int t;
+
+    if (episode->end_timestep <= last_step)
+        return clamped;
+
+    clamped.end_timestep = last_step;
+    clamped.samples = last_step - episode->start_timestep + 1;
+    for (t = episode->start_timestep; t <= last_step; t++)
+    {
+        event = &shm->collision_matrix[t][episode->drone1_id][episode->drone2_id].event_data;
+        dx = event->pos1.x - event->pos2.x;
+        dy = event->pos1.y - event->pos2.y;
+        dz = event->pos1.z - event->pos2.z;
+        separation = sqrtf(dx * dx + dy * dy + dz * dz);
+        if (t == episode->start_timestep || separation < clamped.min_separation)
+            clamped.min_separation = separation;
+    }
+    return clamped;
+}
+
+/* deadline accounting of paced mode (-t) */
+static void report_paced_execution(SharedMemory *shm, FILE *report_file)
+{
+    LatencySummary lateness = summarise_step_lateness(shm);
+    int i;
+
+    fprintf(report_file, "\nPACED EXECUTION (period %.3f ms):\n", shm->options.step_period * 1e3);
+    fprintf(report_file, "- Steps paced: %d\n", lateness.samples);
+    fprintf(report_file, "- Deadline misses: %d (%.1f%%)\n", shm->deadline_misses,
+            lateness.samples > 0 ? 100.0 * shm->deadline_misses / lateness.samples : 0.0);
+    fprintf(report_file, "- Lateness Min/Mean/Max: %.1f / %.1f / %.1f us\n",
+            lateness.min * 1e6, lateness.mean * 1e6, lateness.max * 1e6);
+    fprintf(report_file, "- Lateness p50/p90/p99: %.1f / %.1f / %.1f us\n",
+            lateness.p50 * 1e6, lateness.p90 * 1e6, lateness.p99 * 1e6);
+    fprintf(report_file, "- Jitter histogram:\n");
+    for (i = 0; i < JITTER_BUCKETS; i++)
+    {
+        if (shm->jitter_histogram[i] == 0)
+            continue;
+        if (i == 0)
+            fprintf(report_file, "  < 1 us: %d\n", shm->jitter_histogram[i]);
+        else if (i == JITTER_BUCKETS - 1)
+            fprintf(report_file, "  >= %d us: %d\n", 1 << (i - 1), shm->jitter_histogram[i]);
+        else
+            fprintf(report_file, "  %d-%d us: %d\n", 1 << (i - 1), 1 << i, shm->jitter_histogram[i]);
+    }
+}
+
 /* US365: final simulation report generation */
 void generate_final_report(SharedMemory *shm)
 {
     FILE *report_file;
-    char str[200];
-    int i, active_drones;
+    char str[300];
+    int i, active_drones, last_step = last_counted_step(shm);
 
-    report_file = fopen("simulation_report.txt", "w");
+    report_file = fopen(shm->options.report_path, "w");
     if (report_file == NULL)
     {
         perror("fopen report");
@@ -221,17 +401,28 @@ void generate_final_report(SharedMemory *shm)
             continue;
         }
 
-        Position *pos = &shm->drones[i].current_pos;
+        /* after a threshold stop drones may already have moved past the last
+           counted step (pipelined release, or woken by stop_simulation()),
+           the report shows where they were at that step */
+        Position pos = shm->drones[i].current_pos;
+        if (shm->threshold_timestep >= 0 && is_state_valid(shm, last_step, i))
+            pos = state_position(shm, last_step, i);
         fprintf(report_file, "Drone %d: \n", i + 1);
         fprintf(report_file, " Position: (%.1f, %.1f, %.1f)\n",
-                pos->x, pos->y, pos->z);
+                pos.x, pos.y, pos.z);
     }
 
     fprintf(report_file, "\n");
     fprintf(report_file, "COLLISION ANALYSIS:\n");
-    fprintf(report_file, "- Total collisions detected: %d\n", shm->collision_count);
+    fprintf(report_file, "- Total collisions detected: %d%s\n", shm->collision_count,
+            shm->options.count_episodes ? " (counted as episodes)" : "");
     fprintf(report_file, "- Collision rate: %.2f per timestep\n",
-            shm->current_timestep > 0 ? (float)shm->collision_count / shm->current_timestep : 0.0f);
+            last_step > 0 ? (float)shm->collision_count / last_step : 0.0f);
+    if (shm->substep_collisions_dropped > 0)
+    {
+        fprintf(report_file, "- %d further sub-step collisions not stored or counted (limit %d)\n",
+                shm->substep_collisions_dropped, MAX_SUBSTEP_COLLISIONS);
+    }
 
     if (shm->collision_count == 0)
     {
@@ -244,7 +435,14 @@ void generate_final_report(SharedMemory *shm)
         {
             CollisionEvent *c = &shm->collisions[i];
             fprintf(report_file, "Collision %d:\n", i + 1);
-            fprintf(report_file, " - Timestep: %d\n", c->timestep);
+            if (c->time != c->timestep)
+            {
+                fprintf(report_file, " - Timestep: %.3f (sub-step)\n", c->time);
+            }
+            else
+            {
+                fprintf(report_file, " - Timestep: %d\n", c->timestep);
+            }
             fprintf(report_file, " - Drones involved: %d and %d\n",
                     c->drone1_id, c->drone2_id);
             fprintf(report_file, " - Drone %d position: (%.1f, %.1f, %.1f)\n",
@@ -255,6 +453,40 @@ void generate_final_report(SharedMemory *shm)
         }
     }
 
+    fprintf(report_file, "\nCOLLISION EPISODES:\n");
+    int episodes_reached = 0;
+    for (i = 0; i < shm->episode_count; i++)
+    {
+        if (shm->episodes[i].start_timestep > last_step)
+            continue;
+        CollisionEpisode e = clamp_episode(shm, &shm->episodes[i], last_step);
+        episodes_reached++;
+        fprintf(report_file, "Episode %d: drones %d and %d, timesteps %d-%d (%d samples), min separation %.2f%s\n",
+                episodes_reached, e.drone1_id, e.drone2_id,
+                e.start_timestep, e.end_timestep, e.samples, e.min_separation,
+                shm->episodes[i].end_timestep > last_step ? " (ongoing at termination)" : "");
+    }
+    if (episodes_reached == 0)
+    {
+        fprintf(report_file, "- No collision episodes.\n");
+    }
+
+    report_environment_hits(shm, report_file);
+
+    LatencySummary latency = summarise_step_latency(shm);
+    fprintf(report_file, "\nSTEP LATENCY (%s placement):\n",
+            affinity_policy_name(shm->options.affinity_policy));
+    fprintf(report_file, "- Steps measured: %d\n", latency.samples);
+    fprintf(report_file, "- Min/Mean/Max: %.1f / %.1f / %.1f us\n",
+            latency.min * 1e6, latency.mean * 1e6, latency.max * 1e6);
+    fprintf(report_file, "- p50/p90/p99: %.1f / %.1f / %.1f us\n",
+            latency.p50 * 1e6, latency.p90 * 1e6, latency.p99 * 1e6);
+    fprintf(report_file, "- Time to first step: %.2f ms (%ld minor page faults)\n",
+            shm->startup_latency * 1e3, shm->startup_faults);
+
+    if (shm->options.step_period > 0.0)
+        report_paced_execution(shm, report_file);
+
     fprintf(report_file, "\nSIMULATION VALIDATION RESULT: ");
     if (shm->collision_count >= shm->max_collisions)
     {
@@ -272,6 +504,49 @@ void generate_final_report(SharedMemory *shm)
     }
 
     fclose(report_file);
-    snprintf(str, sizeof(str), "final report generated: simulation_report.txt\n");
+    snprintf(str, sizeof(str), "final report generated: %s\n", shm->options.report_path);
     write(STDOUT_FILENO, str, strlen(str));
-}
\ No newline at end of file
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static LatencySummary summarise_samples(const double *samples, int n)
+{
+    LatencySummary summary;
+    double sorted[MAX_TIMESTEPS], total = 0.0;
+    int i;
+
+    memset(&summary, 0, sizeof(summary));
+    if (n <= 0 || n > MAX_TIMESTEPS)
+        return summary;
+
+    memcpy(sorted, samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_double);
+    for (i = 0; i < n; i++)
+        total += sorted[i];
+
+    summary.samples = n;
+    summary.min = sorted[0];
+    summary.max = sorted[n - 1];
+    summary.mean = total / n;
+    summary.p50 = sorted[(n - 1) * 50 / 100];
+    summary.p90 = sorted[(n - 1) * 90 / 100];
+    summary.p99 = sorted[(n - 1) * 99 / 100];
+    return summary;
+}
+
+/* distribution of the coordinator's per-step latency (seconds) */
+LatencySummary summarise_step_latency(SharedMemory *shm)
+{
+    return summarise_samples(shm->step_latency, shm->step_latency_count);
+}
+
+/* distribution of the paced step releases' lateness (seconds) */
+LatencySummary summarise_step_lateness(SharedMemory *shm)
+{
+    return summarise_samples(shm->step_lateness, shm->paced_steps);
+}
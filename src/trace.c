@@ -0,0 +1,174 @@
+#include "../includes/simulation.h"
+
+/* coordination tracer (-T trace.json): the coordinator, the detection and
+   report threads and every drone group append timestamped events to their own
+   buffer in shared memory; after the run the buffers are paired up into
+   slices and written in the Chrome trace event format, one event per line,
+   for chrome://tracing, Perfetto and ./trace_analyser */
+
+#define TRACE_PID_COORDINATOR 1
+#define TRACE_PID_DRONES 2
+
+static uint64_t trace_origin;
+
+/* starts a new trace, called before the drones are started */
+void reset_trace(SharedMemory *shm)
+{
+    if (shm->options.trace_path[0] == '\0')
+        return;
+    memset(shm->trace_count, 0, sizeof(shm->trace_count));
+    shm->trace_dropped = 0;
+}
+
+/* each buffer has a single writer, so an event is a clock read and a store */
+void trace_event(SharedMemory *shm, int buffer, int type, int step)
+{
+    struct timespec now;
+    TraceEvent *event;
+
+    if (shm->options.trace_path[0] == '\0')
+        return;
+    if (shm->trace_count[buffer] >= TRACE_CAPACITY)
+    {
+        __sync_fetch_and_add(&shm->trace_dropped, 1);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    event = &shm->trace[buffer][shm->trace_count[buffer]];
+    event->ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    event->step = step;
+    event->type = type;
+    shm->trace_count[buffer]++;
+}
+
+static double trace_us(uint64_t ns)
+{
+    return (ns - trace_origin) / 1e3;
+}
+
+static void write_slice(FILE *fp, const char *name, int pid, int tid,
+                        const TraceEvent *begin, const TraceEvent *end)
+{
+    fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"step\":%d}},\n",
+            name, pid, tid, trace_us(begin->ns), (end->ns - begin->ns) / 1e3, begin->step);
+}
+
+/* barrier wait, hand-over and detection wait of every completed round */
+static void write_coordinator(SharedMemory *shm, FILE *fp)
+{
+    const TraceEvent *e = shm->trace[TRACE_COORDINATOR], *mark[TRACE_RELEASE] = {NULL, NULL, NULL};
+    int n;
+
+    for (n = 0; n < shm->trace_count[TRACE_COORDINATOR]; n++)
+    {
+        if (e[n].type < TRACE_RELEASE)
+        {
+            mark[e[n].type] = &e[n];
+            continue;
+        }
+        if (!mark[TRACE_STEP_BEGIN] || !mark[TRACE_BARRIER_DONE] || !mark[TRACE_DETECT_WAIT] ||
+            mark[TRACE_STEP_BEGIN]->step != e[n].step || mark[TRACE_DETECT_WAIT]->step != e[n].step)
+            continue;
+        write_slice(fp, "barrier wait", TRACE_PID_COORDINATOR, TRACE_COORDINATOR,
+                    mark[TRACE_STEP_BEGIN], mark[TRACE_BARRIER_DONE]);
+        write_slice(fp, "handoff", TRACE_PID_COORDINATOR, TRACE_COORDINATOR,
+                    mark[TRACE_BARRIER_DONE], mark[TRACE_DETECT_WAIT]);
+        write_slice(fp, "detection wait", TRACE_PID_COORDINATOR, TRACE_COORDINATOR,
+                    mark[TRACE_DETECT_WAIT], &e[n]);
+    }
+}
+
+static void write_detection(SharedMemory *shm, FILE *fp)
+{
+    const TraceEvent *e = shm->trace[TRACE_DETECTION], *start = NULL;
+    int n;
+
+    for (n = 0; n < shm->trace_count[TRACE_DETECTION]; n++)
+    {
+        if (e[n].type == TRACE_DETECT_START)
+            start = &e[n];
+        else if (start && start->step == e[n].step)
+            write_slice(fp, "detect", TRACE_PID_COORDINATOR, TRACE_DETECTION, start, &e[n]);
+    }
+
+    e = shm->trace[TRACE_REPORT];
+    for (n = 0; n < shm->trace_count[TRACE_REPORT]; n++)
+    {
+        fprintf(fp, "{\"name\":\"report wakeup\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"step\":%d}},\n",
+                TRACE_PID_COORDINATOR, TRACE_REPORT, trace_us(e[n].ns), e[n].step);
+    }
+}
+
+/* a group moves from its wake-up to its arrival and is parked from its
+   arrival to the next wake-up */
+static void write_drone_group(SharedMemory *shm, FILE *fp, int group)
+{
+    const TraceEvent *e = shm->trace[TRACE_DRONES + group], *last = NULL;
+    int n;
+
+    for (n = 0; n < shm->trace_count[TRACE_DRONES + group]; n++)
+    {
+        if (last && last->type == TRACE_WAKE && e[n].type == TRACE_ARRIVE)
+            write_slice(fp, "move", TRACE_PID_DRONES, group, last, &e[n]);
+        else if (last && last->type == TRACE_ARRIVE && e[n].type == TRACE_WAKE)
+            write_slice(fp, "parked", TRACE_PID_DRONES, group, last, &e[n]);
+        last = &e[n];
+    }
+}
+
+void write_trace(SharedMemory *shm)
+{
+    int b, g, n, groups = drone_group_count(shm), events = 0;
+    char str[400];
+    FILE *fp;
+
+    if (shm->options.trace_path[0] == '\0')
+        return;
+
+    trace_origin = UINT64_MAX;
+    for (b = 0; b < TRACE_DRONES + groups; b++)
+    {
+        events += shm->trace_count[b];
+        for (n = 0; n < shm->trace_count[b]; n++)
+        {
+            if (shm->trace[b][n].ns < trace_origin)
+                trace_origin = shm->trace[b][n].ns;
+        }
+    }
+
+    if (!(fp = fopen(shm->options.trace_path, "w")))
+    {
+        perror("fopen trace");
+        return;
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    write_coordinator(shm, fp);
+    write_detection(shm, fp);
+    for (g = 0; g < groups; g++)
+    {
+        write_drone_group(shm, fp, g);
+    }
+
+    /* names last, so the final event needs no special separator */
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"coordinator\"}},\n",
+            TRACE_PID_COORDINATOR, TRACE_COORDINATOR);
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"detection\"}},\n",
+            TRACE_PID_COORDINATOR, TRACE_DETECTION);
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"report\"}},\n",
+            TRACE_PID_COORDINATOR, TRACE_REPORT);
+    for (g = 0; g < groups; g++)
+    {
+        fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"group %d\"}},\n",
+                TRACE_PID_DRONES, g, g);
+    }
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"drone groups\"}},\n",
+            TRACE_PID_DRONES);
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"coordinator\"}}\n]}\n",
+            TRACE_PID_COORDINATOR);
+    fclose(fp);
+
+    snprintf(str, sizeof(str), "Trace: %d events from %d groups written to %s (%d dropped)\n",
+             events, groups, shm->options.trace_path, shm->trace_dropped);
+    write(STDOUT_FILENO, str, strlen(str));
+}
@@ -0,0 +1,254 @@
+#include "../includes/simulation.h"
+
+/* offline analyser for the coordination traces written with ./drone -T:
+   replays the slices of every barrier round and splits the step latency
+   along its critical path (the wake-up and move of the last group to arrive,
+   the barrier notification, the hand-over and the detection wait) and
+   reports how long the drone groups sat idle at the barrier */
+
+#define MAX_TRACE_GROUPS MAX_DRONES
+
+typedef struct
+{
+    double ts;
+    double dur;
+} Slice;
+
+typedef struct
+{
+    Slice barrier;
+    Slice handoff;
+    Slice detection_wait;
+    Slice detect;
+    Slice move[MAX_TRACE_GROUPS];
+    int seen;
+} Round;
+
+/* critical path of one round, all times in microseconds */
+typedef struct
+{
+    int step;
+    int group;
+    double latency;
+    double wake;
+    double move;
+    double notify;
+    double handoff;
+    double detection_wait;
+    double drone_idle;
+    double detect;
+} RoundPath;
+
+static Round rounds[MAX_TIMESTEPS + 1];
+static int group_count;
+
+static double slice_end(const Slice *s)
+{
+    return s->ts + s->dur;
+}
+
+static void store_slice(const char *name, int pid, int tid, int step, Slice slice)
+{
+    Round *r;
+
+    if (step < 0 || step > MAX_TIMESTEPS)
+        return;
+    r = &rounds[step];
+
+    if (pid == 2 && tid >= 0 && tid < MAX_TRACE_GROUPS)
+    {
+        if (strcmp(name, "move") == 0)
+            r->move[tid] = slice;
+        if (tid >= group_count)
+            group_count = tid + 1;
+        return;
+    }
+    if (strcmp(name, "barrier wait") == 0)
+    {
+        r->barrier = slice;
+        r->seen = 1;
+    }
+    else if (strcmp(name, "handoff") == 0)
+        r->handoff = slice;
+    else if (strcmp(name, "detection wait") == 0)
+        r->detection_wait = slice;
+    else if (strcmp(name, "detect") == 0)
+        r->detect = slice;
+}
+
+/* the tracer writes one event per line, so the slices are read back with a
+   fixed pattern instead of a JSON parser */
+static int load_trace(const char *path)
+{
+    char line[512], name[32];
+    int pid, tid, step, slices = 0;
+    Slice slice;
+    FILE *fp;
+
+    if (!(fp = fopen(path, "r")))
+    {
+        perror("fopen trace");
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "{\"name\":\"%31[^\"]\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%lf,\"dur\":%lf,\"args\":{\"step\":%d}}",
+                   name, &pid, &tid, &slice.ts, &slice.dur, &step) != 6)
+            continue;
+        store_slice(name, pid, tid, step, slice);
+        slices++;
+    }
+    fclose(fp);
+    return slices;
+}
+
+/* the round is released when the detection wait ends; the last group to
+   arrive is on its critical path, from the previous release to its arrival */
+static void analyse_round(int step, RoundPath *path)
+{
+    Round *r = &rounds[step];
+    double release = slice_end(&r->detection_wait), arrival = -1.0;
+    int g;
+
+    memset(path, 0, sizeof(*path));
+    path->step = step;
+    path->group = -1;
+    /* release to release, so the path components add up to the latency */
+    path->latency = release - (step > 0 && rounds[step - 1].seen ? slice_end(&rounds[step - 1].detection_wait)
+                                                                  : r->barrier.ts);
+    path->handoff = r->handoff.dur;
+    path->detection_wait = r->detection_wait.dur;
+    path->detect = r->detect.dur;
+
+    for (g = 0; g < group_count; g++)
+    {
+        if (r->move[g].dur <= 0.0 && r->move[g].ts <= 0.0)
+            continue;
+        path->drone_idle += release - slice_end(&r->move[g]);
+        if (slice_end(&r->move[g]) > arrival)
+        {
+            arrival = slice_end(&r->move[g]);
+            path->group = g;
+        }
+    }
+    if (path->group < 0)
+        return;
+
+    path->move = r->move[path->group].dur;
+    path->notify = slice_end(&r->barrier) - arrival;
+    if (step > 0 && rounds[step - 1].seen)
+        path->wake = r->move[path->group].ts - slice_end(&rounds[step - 1].detection_wait);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    const RoundPath *x = a, *y = b;
+    return (x->latency < y->latency) - (x->latency > y->latency);
+}
+
+static void print_round(const RoundPath *p)
+{
+    printf("%5d %10.1f %6d %8.1f %8.1f %8.1f %8.1f %10.1f %10.1f %8.1f\n",
+           p->step, p->latency, p->group, p->wake, p->move, p->notify, p->handoff,
+           p->detection_wait, p->drone_idle, p->detect);
+}
+
+static void print_header(void)
+{
+    printf("%5s %10s %6s %8s %8s %8s %8s %10s %10s %8s\n", "step", "latency", "group",
+           "wake", "move", "notify", "handoff", "det.wait", "drone idle", "detect");
+}
+
+int main(int argc, char *argv[])
+{
+    static RoundPath paths[MAX_TIMESTEPS + 1];
+    RoundPath total;
+    int opt, step, count = 0, slowest = 5, all = 0, slices, first, steady;
+
+    while ((opt = getopt(argc, argv, "n:a")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            slowest = atoi(optarg);
+            break;
+        case 'a':
+            all = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n slowest] [-a] trace.json\n", argv[0]);
+            fprintf(stderr, "  -n  rounds listed by latency (default 5)\n");
+            fprintf(stderr, "  -a  list every round in step order\n");
+            exit(1);
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "No trace given, record one with ./drone -T trace.json\n");
+        exit(1);
+    }
+    if ((slices = load_trace(argv[optind])) < 0)
+        exit(2);
+
+    memset(&total, 0, sizeof(total));
+    for (step = 0; step <= MAX_TIMESTEPS; step++)
+    {
+        if (!rounds[step].seen || rounds[step].detection_wait.ts <= 0.0)
+            continue;
+        analyse_round(step, &paths[count++]);
+    }
+
+    /* round 0 also holds the start of the drone processes and is left out
+       of the steady-state figures */
+    first = count > 0 && paths[0].step == 0;
+    steady = count - first;
+    if (steady == 0)
+    {
+        fprintf(stderr, "No complete barrier round after the first in %s (%d slices)\n", argv[optind], slices);
+        exit(3);
+    }
+    for (step = first; step < count; step++)
+    {
+        total.latency += paths[step].latency;
+        total.wake += paths[step].wake;
+        total.move += paths[step].move;
+        total.notify += paths[step].notify;
+        total.handoff += paths[step].handoff;
+        total.detection_wait += paths[step].detection_wait;
+        total.drone_idle += paths[step].drone_idle;
+        total.detect += paths[step].detect;
+    }
+
+    printf("%d rounds, %d drone groups, times in microseconds\n", count, group_count);
+    if (first)
+        printf("Round 0 (drone start-up): %.1f us\n", paths[0].latency);
+    if (all)
+    {
+        print_header();
+        for (step = 0; step < count; step++)
+            print_round(&paths[step]);
+    }
+    count = steady;
+
+    printf("\nCritical path share of the total step latency (%.1f us, %.1f us per round):\n",
+           total.latency, total.latency / count);
+    printf("  wake-up of the last group  %10.1f  %5.1f%%\n", total.wake, 100.0 * total.wake / total.latency);
+    printf("  move of the last group     %10.1f  %5.1f%%\n", total.move, 100.0 * total.move / total.latency);
+    printf("  barrier notification       %10.1f  %5.1f%%\n", total.notify, 100.0 * total.notify / total.latency);
+    printf("  hand-over to detection     %10.1f  %5.1f%%\n", total.handoff, 100.0 * total.handoff / total.latency);
+    printf("  detection wait             %10.1f  %5.1f%%\n", total.detection_wait,
+           100.0 * total.detection_wait / total.latency);
+    printf("Drone groups idle at the barrier: %.1f us (%.1f us per group and round)\n",
+           total.drone_idle, total.drone_idle / count / (group_count > 0 ? group_count : 1));
+    printf("Detection thread busy: %.1f us (%.1f us per round)\n", total.detect, total.detect / count);
+
+    if (slowest > 0)
+    {
+        qsort(paths + first, count, sizeof(RoundPath), compare_latency);
+        printf("\nSlowest rounds:\n");
+        print_header();
+        for (step = 0; step < count && step < slowest; step++)
+            print_round(&paths[first + step]);
+    }
+    return 0;
+}